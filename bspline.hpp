@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>           // for clamp
 #include <array>               // for array<>::value_type, array
 #include <cassert>             // for assert
 #include <cmath>               // for floor
@@ -56,6 +57,23 @@ Eigen::Matrix<glm::dvec3, NX + 2 * NExtra, NY + 2 * NExtra> PadSurface(
   return clamped_ps;
 }
 
+// PadSurface for a grid whose size is only known at runtime.
+inline Eigen::Matrix<glm::dvec3, Eigen::Dynamic, Eigen::Dynamic> PadSurface(
+    const Eigen::Matrix<glm::dvec3, Eigen::Dynamic, Eigen::Dynamic> &ps) {
+  const auto nx = static_cast<int>(ps.rows());
+  const auto ny = static_cast<int>(ps.cols());
+  Eigen::Matrix<glm::dvec3, Eigen::Dynamic, Eigen::Dynamic> clamped_ps(nx + 2 * NExtra,
+                                                                       ny + 2 * NExtra);
+  // Padding with copies of the edges is the same as clamping the index.
+  for (int kx = 0; kx < nx + 2 * NExtra; kx++) {
+    for (int ky = 0; ky < ny + 2 * NExtra; ky++) {
+      clamped_ps(kx, ky) =
+          ps(std::clamp(kx - NExtra, 0, nx - 1), std::clamp(ky - NExtra, 0, ny - 1));
+    }
+  }
+  return clamped_ps;
+}
+
 static inline double Cubed(const double x) { return x * x * x; }
 
 template <int NU, int NV>
@@ -64,8 +82,115 @@ struct Surface {
   Eigen::Matrix<glm::dvec3, NU, NV> tangent_u;
   Eigen::Matrix<glm::dvec3, NU, NV> tangent_v;
   Eigen::Matrix<glm::dvec3, NU, NV> normal;
+  // second derivatives, for curvature
+  Eigen::Matrix<glm::dvec3, NU, NV> position_uu;
+  Eigen::Matrix<glm::dvec3, NU, NV> position_vv;
+  Eigen::Matrix<glm::dvec3, NU, NV> position_uv;
+};
+
+// Derivatives are with respect to the parameter within the current knot interval, which is an
+// affine function of sx and sy.
+struct SurfacePoint {
+  glm::dvec3 position;
+  glm::dvec3 tangent_u;
+  glm::dvec3 tangent_v;
+  glm::dvec3 normal;
+  glm::dvec3 position_uu;
+  glm::dvec3 position_vv;
+  glm::dvec3 position_uv;
 };
 
+// Evaluate a cubic B-spline surface at (sx, sy) in [0, 1] x [0, 1]. ps is any Eigen matrix of
+// control points, so this serves both the fixed size grids and grids only known at runtime.
+template <typename ControlPoints>
+SurfacePoint CubicBSplinePoint(const ControlPoints &ps, const double sx, const double sy) {
+  const auto nx = static_cast<int>(ps.rows());
+  const auto ny = static_cast<int>(ps.cols());
+  const double tx = 3 + sx * (nx - 3);  // t from 3 to n
+  const double ty = 3 + sy * (ny - 3);  // t from 3 to n
+
+  int interval_x = static_cast<int>(std::floor(tx));
+  int interval_y = static_cast<int>(std::floor(ty));
+  double ux = tx - static_cast<double>(interval_x);
+  double uy = ty - static_cast<double>(interval_y);
+
+  if (interval_x == nx && ux == 0) {
+    interval_x = nx - 1;
+    ux = 1;
+  }
+
+  if (interval_y == ny && uy == 0) {
+    interval_y = ny - 1;
+    uy = 1;
+  }
+
+  assert(ux >= 0);
+  assert(ux <= 1);
+  assert(uy >= 0);
+  assert(uy <= 1);
+
+  const double ux2 = ux * ux;
+  const double ux3 = ux2 * ux;
+
+  const double uy2 = uy * uy;
+  const double uy3 = uy2 * uy;
+
+  const std::array<double, 4> cxs = {Cubed(1. - ux), 3 * ux3 - 6 * ux2 + 4,
+                                     -3. * ux3 + 3. * ux2 + 3. * ux + 1, ux3};
+  const std::array<double, 4> cys = {Cubed(1. - uy), 3 * uy3 - 6 * uy2 + 4,
+                                     -3. * uy3 + 3. * uy2 + 3. * uy + 1, uy3};
+
+  const std::array<double, 4> deriv_cxs = {-3 * (1. - ux) * (1. - ux), 9 * ux2 - 12 * ux,
+                                           -9. * ux2 + 6. * ux + 3., 3 * ux2};
+  const std::array<double, 4> deriv_cys = {-3 * (1. - uy) * (1. - uy), 9 * uy2 - 12 * uy,
+                                           -9. * uy2 + 6. * uy + 3., 3 * uy2};
+
+  const std::array<double, 4> second_deriv_cxs = {6 * (1. - ux), 18 * ux - 12, -18 * ux + 6,
+                                                  6 * ux};
+  const std::array<double, 4> second_deriv_cys = {6 * (1. - uy), 18 * uy - 12, -18 * uy + 6,
+                                                  6 * uy};
+
+  glm::dvec3 position = {0, 0, 0};
+  glm::dvec3 tangent_u = {0, 0, 0};
+  glm::dvec3 tangent_v = {0, 0, 0};
+  glm::dvec3 position_uu = {0, 0, 0};
+  glm::dvec3 position_vv = {0, 0, 0};
+  glm::dvec3 position_uv = {0, 0, 0};
+  for (int kx = 0; kx < 4; kx++) {
+    for (int ky = 0; ky < 4; ky++) {
+      const glm::dvec3 &p = ps(interval_x - 3 + kx, interval_y - 3 + ky);
+      // clang-format off
+      position  +=       cxs[kx]*      cys[ky]*p; //NOLINT(cppcoreguidelines-pro-bounds-constant-array-index)
+      tangent_u += deriv_cxs[kx]*      cys[ky]*p; //NOLINT(cppcoreguidelines-pro-bounds-constant-array-index)
+      tangent_v +=       cxs[kx]*deriv_cys[ky]*p; //NOLINT(cppcoreguidelines-pro-bounds-constant-array-index)
+      position_uu += second_deriv_cxs[kx]*cys[ky]*p; //NOLINT(cppcoreguidelines-pro-bounds-constant-array-index)
+      position_vv += cxs[kx]*second_deriv_cys[ky]*p; //NOLINT(cppcoreguidelines-pro-bounds-constant-array-index)
+      position_uv += deriv_cxs[kx]*deriv_cys[ky]*p; //NOLINT(cppcoreguidelines-pro-bounds-constant-array-index)
+      // clang-format on
+    }
+  }
+  position.x /= 36;
+  position.y /= 36;
+  position.z /= 36;
+  tangent_u.x /= 36;
+  tangent_u.y /= 36;
+  tangent_u.z /= 36;
+  tangent_v.x /= 36;
+  tangent_v.y /= 36;
+  tangent_v.z /= 36;
+  position_uu.x /= 36;
+  position_uu.y /= 36;
+  position_uu.z /= 36;
+  position_vv.x /= 36;
+  position_vv.y /= 36;
+  position_vv.z /= 36;
+  position_uv.x /= 36;
+  position_uv.y /= 36;
+  position_uv.z /= 36;
+  return {position,    tangent_u,   tangent_v,  glm::normalize(glm::cross(tangent_u, tangent_v)),
+          position_uu, position_vv, position_uv};
+}
+
 template <int NU, int NV, int NX, int NY>
 Surface<NU, NV> CubicBSplineSurface(const Eigen::Matrix<glm::dvec3, NX, NY> &ps) {
   Surface<NU, NV> interpolated;
@@ -73,71 +198,14 @@ Surface<NU, NV> CubicBSplineSurface(const Eigen::Matrix<glm::dvec3, NX, NY> &ps)
     for (int kv = 0; kv < NV; kv++) {
       const double sx = static_cast<double>(ku) / (static_cast<double>(NU) - 1);
       const double sy = static_cast<double>(kv) / (static_cast<double>(NV) - 1);
-      const double tx = 3 + sx * (NX - 3);  // t from 3 to n
-      const double ty = 3 + sy * (NY - 3);  // t from 3 to n
-
-      int interval_x = static_cast<int>(std::floor(tx));
-      int interval_y = static_cast<int>(std::floor(ty));
-      double ux = tx - static_cast<double>(interval_x);
-      double uy = ty - static_cast<double>(interval_y);
-
-      if (interval_x == NX && ux == 0) {
-        interval_x = NX - 1;
-        ux = 1;
-      }
-
-      if (interval_y == NY && uy == 0) {
-        interval_y = NY - 1;
-        uy = 1;
-      }
-
-      assert(ux >= 0);
-      assert(ux <= 1);
-      assert(uy >= 0);
-      assert(uy <= 1);
-
-      const double ux2 = ux * ux;
-      const double ux3 = ux2 * ux;
-
-      const double uy2 = uy * uy;
-      const double uy3 = uy2 * uy;
-
-      const std::array<double, 4> cxs = {Cubed(1. - ux), 3 * ux3 - 6 * ux2 + 4,
-                                         -3. * ux3 + 3. * ux2 + 3. * ux + 1, ux3};
-      const std::array<double, 4> cys = {Cubed(1. - uy), 3 * uy3 - 6 * uy2 + 4,
-                                         -3. * uy3 + 3. * uy2 + 3. * uy + 1, uy3};
-
-      const std::array<double, 4> deriv_cxs = {-3 * (1. - ux) * (1. - ux), 9 * ux2 - 12 * ux,
-                                               -9. * ux2 + 6. * ux + 3., 3 * ux2};
-      const std::array<double, 4> deriv_cys = {-3 * (1. - uy) * (1. - uy), 9 * uy2 - 12 * uy,
-                                               -9. * uy2 + 6. * uy + 3., 3 * uy2};
-
-      glm::dvec3 position = {0, 0, 0};
-      glm::dvec3 tangent_u = {0, 0, 0};
-      glm::dvec3 tangent_v = {0, 0, 0};
-      for (int kx = 0; kx < 4; kx++) {
-        for (int ky = 0; ky < 4; ky++) {
-          const glm::dvec3 &p = ps(interval_x - 3 + kx, interval_y - 3 + ky);
-          // clang-format off
-          position  +=       cxs[kx]*      cys[ky]*p; //NOLINT(cppcoreguidelines-pro-bounds-constant-array-index)
-          tangent_u += deriv_cxs[kx]*      cys[ky]*p; //NOLINT(cppcoreguidelines-pro-bounds-constant-array-index)
-          tangent_v +=       cxs[kx]*deriv_cys[ky]*p; //NOLINT(cppcoreguidelines-pro-bounds-constant-array-index)
-          // clang-format on
-        }
-      }
-      position.x /= 36;
-      position.y /= 36;
-      position.z /= 36;
-      tangent_u.x /= 36;
-      tangent_u.y /= 36;
-      tangent_u.z /= 36;
-      tangent_v.x /= 36;
-      tangent_v.y /= 36;
-      tangent_v.z /= 36;
-      interpolated.position(ku, kv) = position;
-      interpolated.tangent_u(ku, kv) = tangent_u;
-      interpolated.tangent_v(ku, kv) = tangent_v;
-      interpolated.normal(ku, kv) = glm::normalize(glm::cross(tangent_u, tangent_v));
+      const SurfacePoint point = CubicBSplinePoint(ps, sx, sy);
+      interpolated.position(ku, kv) = point.position;
+      interpolated.tangent_u(ku, kv) = point.tangent_u;
+      interpolated.tangent_v(ku, kv) = point.tangent_v;
+      interpolated.normal(ku, kv) = point.normal;
+      interpolated.position_uu(ku, kv) = point.position_uu;
+      interpolated.position_vv(ku, kv) = point.position_vv;
+      interpolated.position_uv(ku, kv) = point.position_uv;
     }
   }
 
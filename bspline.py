@@ -6,6 +6,14 @@ import time
 import matplotlib.pyplot as plt
 from mpl_toolkits.mplot3d import Axes3D
 
+# The surfaces are evaluated by bspline.hpp through the extension when it's built
+# (bazel build //:basketball_py), so this file can't drift from what the optimizer uses. The pure
+# Python versions below are the fallback and the readable reference.
+try:
+  import basketball
+except ImportError:
+  basketball = None
+
 def cubic_bezier(u, p0, p1, p2, p3):
   """
   u in [0, 1]
@@ -121,7 +129,7 @@ def cubic_clamped_bspline(s, ps):
   n_extra = 2
   return cubic_bspline(s, n_extra*[ps[0]] + ps + n_extra*[ps[-1]])
 
-def cubic_clamped_bspline2(sx, sy, ps):
+def reference_cubic_clamped_bspline2(sx, sy, ps):
   n_extra = 2
   nx, ny, nps = ps.shape
   clamped_ps = np.empty((nx+2*n_extra, ny+2*n_extra, nps))
@@ -147,6 +155,20 @@ def cubic_clamped_bspline2(sx, sy, ps):
   assert not np.any(np.isnan(clamped_ps))
   return cubic_bspline2(sx, sy, clamped_ps)
 
+def cubic_clamped_bspline2(sx, sy, ps):
+  if basketball is None or ps.shape[2] != 3:
+    return reference_cubic_clamped_bspline2(sx, sy, ps)
+  position, _, _, _ = basketball.surface(ps, [[sx, sy]])
+  return position[0]
+
+def cubic_clamped_bspline_surface(us, vs, ps):
+  """
+  the surface at every (u, v), len(vs) x len(us) x 3
+  """
+  if basketball is None or ps.shape[2] != 3:
+    return np.array([[reference_cubic_clamped_bspline2(u, v, ps) for u in us] for v in vs])
+  return basketball.surface_grid(ps, us, vs)
+
 def main():
   ps = [
     np.array([1., 0.]),
@@ -175,7 +197,7 @@ def main():
   us = np.linspace(0., 1., 50)
   vs = np.linspace(0., 1., 51)
 
-  xyzs_interp = np.array([[cubic_clamped_bspline2(u, v, ps) for u in us] for v in vs])
+  xyzs_interp = cubic_clamped_bspline_surface(us, vs, ps)
   xs = xyzs_interp[:, :, 0][:]
   ys = xyzs_interp[:, :, 1][:]
   zs = xyzs_interp[:, :, 2][:]
@@ -2,70 +2,219 @@
 #include <sys/types.h>       // for key_t, uint
 
 #include <algorithm>           // for copy, max
+#include <array>               // for array
+#include <atomic>              // for atomic
 #include <chrono>              // for operator""s, chrono_literals
+#include <csignal>             // for signal, SIGPIPE, SIG_IGN
+#include <cinttypes>           // for PRIu64
+#include <cstdint>             // for uint64_t
 #include <cstdio>              // for fprintf, stderr
-#include <cstdlib>             // for EXIT_SUCCESS
+#include <cstring>             // for memcpy
+#include <cstdlib>             // for EXIT_SUCCESS, EXIT_FAILURE
 #include <eigen3/Eigen/Dense>  // for Matrix, DenseCoeffsBase
+#include <filesystem>          // for create_directories
 #include <functional>          // for function
 #include <iostream>            // for operator<<, basic_ostream, cerr, endl, ostream, cha...
+#include <limits>              // for numeric_limits
 #include <mutex>               // for mutex, lock_guard
 #include <optional>            // for optional, nullopt
 #include <queue>               // for queue
+#include <random>              // for mt19937_64
+#include <string>              // for string
 #include <thread>              // for sleep_for, thread
 #include <vector>              // for vector
 
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>  // for glfwDestroyWindow, glfwGetWindowSize, glfwPollEv...
 
-#include <glm/glm.hpp>  // for mat4
-#include <nlopt.hpp>    // for opt, LN_NELDERMEAD
+#include <glm/glm.hpp>                   // for mat4, vec3, dvec3
+#include <glm/gtc/matrix_transform.hpp>  // for lookAt, perspective
+#include <nlopt.hpp>                     // for opt, algorithm, LD_SLSQP, LN_COBYLA, forced_stop
 
-#include "bb3d/assert.hpp"            // for ASSERT
-#include "bb3d/opengl_context.hpp"    // for Window
-#include "problem/backboard.hpp"      // for Backboard
-#include "problem/problem.hpp"        // for Problem
-#include "problem/visualization.hpp"  // for ProblemVisualization
+#include "bb3d/assert.hpp"              // for ASSERT
+#include "bb3d/opengl_context.hpp"      // for Window
+#include "problem/aero.hpp"             // for AeroParameters, CheckAeroIntegratorAgainstBounce
+#include "problem/backboard.hpp"        // for Backboard
+#include "problem/config.hpp"           // for NX, NY, NU_OBJ, NV_OBJ, NU_VIS, Vec2Dvs, Dvs2Vec
+#include "problem/landing_heatmap.hpp"  // for LandingHeatmap
+#include "problem/manufacturing.hpp"    // for ManufacturingConstraints, ManufacturingLimits
+#include "problem/objective_cache.hpp"  // for ObjectiveCache, ObjectiveCache::Entry
+#include "problem/parallel.hpp"         // for NumThreads
+#include "problem/problem.hpp"          // for Problem, Problem<>::Sampling
+#include "problem/shot.hpp"             // for Sample
+#include "problem/shot_set.hpp"         // for ShotSet
+#include "problem/spsa.hpp"             // for Spsa, SpsaObjective, SpsaOptions
+#include "problem/visualization.hpp"    // for ProblemVisualization
+#include "render/frame_encoder.hpp"     // for FrameEncoderPool
+#include "render/offscreen.hpp"         // for OffscreenRenderer
 
-constexpr int NX = 6;
-constexpr int NY = 4;
+// Exact (bitwise) design vector keys. Set a positive quantum to also match nearby designs.
+constexpr size_t kObjectiveCacheCapacity = 1U << 16U;
+constexpr double kObjectiveCacheQuantum = 0;
 
-constexpr int NU_VIS = 20;
-constexpr int NV_VIS = 30;
+// (shot point, bounce point) pairs per objective estimate when optimizing with --spsa.
+constexpr int kMinibatchSize = 60;
 
-constexpr int NU_OBJ = 14;
-constexpr int NV_OBJ = 8;
+constexpr size_t kMaxDrawnShots = 20;
 
-Eigen::Matrix<double, NX, NY> Vec2Dvs(const std::vector<double> &vec) {
-  ASSERT(NX * NY == vec.size());
-  Eigen::Matrix<double, NX, NY> mat;
-  int k = 0;
-  for (int kx = 0; kx < NX; kx++) {
-    for (int ky = 0; ky < NY; ky++) {
-      mat(kx, ky) = vec[k];
-      k++;
+constexpr int kOffscreenWidth = 1280;
+constexpr int kOffscreenHeight = 720;
+// Frames waiting to be encoded before rendering waits for the encoders (about 440 MB).
+constexpr size_t kMaxQueuedFrames = 120;
+
+// Slack allowed on each manufacturing constraint, in the units of its limit.
+constexpr double kManufacturingTol = 1e-6;
+
+// The ball's flight off the backboard with --aero, for the optimizer and the drawing alike.
+const AeroParameters kAeroParameters;
+
+// Designs per epoch of the long-run landing heatmap, and how often designs are recorded in it
+// (every design would cost more than the objective evaluation itself).
+constexpr uint64_t kHeatmapDesignsPerEpoch = 100;
+constexpr int kHeatmapStride = 10;
+
+// Longest the window goes without redrawing while nothing changes. Window::Run counts an idle wait
+// in the next frame's time step, so this is also how far behind the camera can start moving when a
+// key goes down during one.
+constexpr double kIdleRedrawPeriod = 0.1;
+
+
+struct SharedData {
+  std::queue<Eigen::Matrix<double, NX, NY>> dvs_queue;
+  std::mutex queue_mutex;
+  std::atomic<bool> optimization_done{false};
+  // Set to make the optimizer return early, keeping the best design so far.
+  std::atomic<bool> stop{false};
+  // Wake the window's event loop when a design arrives. Only set while the event loop is running,
+  // and only cleared under queue_mutex.
+  std::atomic<bool> post_empty_event{false};
+  // Where the shots from these points land, for every kHeatmapStride-th design the optimizer
+  // evaluates. Only these shots are recorded, not the whole shot set. Nothing is recorded while
+  // it's null. Set before the optimizer starts.
+  const ShotSet *heatmap_shot_set = nullptr;
+  // How they fly off the backboard, nullptr for drag-free. Set before the optimizer starts.
+  const AeroParameters *heatmap_aero = nullptr;
+  LandingHeatmap landing_heatmap{kHeatmapDesignsPerEpoch};
+};
+
+// Record landings on the NU x NV grid the optimizer is evaluating designs on.
+template <int NU, int NV>
+void RecordLandings(SharedData &shared_data, const Eigen::Matrix<double, NX, NY> &dvs) {
+  if (shared_data.heatmap_shot_set == nullptr) {
+    return;
+  }
+  const Eigen::Matrix<glm::dvec3, NX, NY> control_points = Backboard<NX, NY>::ToControlPoints(dvs);
+  if (shared_data.heatmap_aero != nullptr) {
+    for (const glm::dvec3 &landing_point : Problem<NX, NY>::ComputeAeroLandings<NU, NV>(
+             control_points, *shared_data.heatmap_shot_set, *shared_data.heatmap_aero)) {
+      shared_data.landing_heatmap.Add(landing_point);
+    }
+  } else {
+    for (const Sample &sample :
+         Problem<NX, NY>::ComputeShots<NU, NV>(control_points, *shared_data.heatmap_shot_set)) {
+      shared_data.landing_heatmap.Add(sample.bounce_.landing_point_);
     }
   }
-  return mat;
+  shared_data.landing_heatmap.EndDesign();
 }
-std::vector<double> Dvs2Vec(const Eigen::Matrix<double, NX, NY> &mat) {
-  std::vector<double> vec;
-  vec.reserve(NX * NY);
-  for (int kx = 0; kx < NX; kx++) {
-    for (int ky = 0; ky < NY; ky++) {
-      vec.push_back(mat(kx, ky));
+
+// Send a design to the visualizer.
+void PushDvs(SharedData &shared_data, const Eigen::Matrix<double, NX, NY> &dvs) {
+  const std::lock_guard<std::mutex> lock(shared_data.queue_mutex);
+  // If the queue isn't empty the window hasn't caught up with the last design and isn't waiting,
+  // so there's no need to flood it with events.
+  const bool wake = shared_data.post_empty_event && shared_data.dvs_queue.empty();
+  shared_data.dvs_queue.push(dvs);
+  if (wake) {
+    glfwPostEmptyEvent();
+  }
+}
+
+// Objective cache tag for a configuration: an FNV-1a hash of everything besides the design that
+// the objective depends on, so evaluations of different configurations are never mixed.
+template <int NU, int NV>
+uint64_t CacheTag(const ShotSet &shot_set, const AeroParameters *aero, const BallParameters *ball) {
+  uint64_t hash = 14695981039346656037ULL;
+  auto add = [&hash](const uint64_t word) {
+    hash ^= word;
+    hash *= 1099511628211ULL;
+  };
+  auto add_double = [&add](const double value) {
+    uint64_t bits{};
+    memcpy(&bits, &value, sizeof(bits));
+    add(bits);
+  };
+  add(shot_set.Fingerprint());
+  add(NU);
+  add(NV);
+  // Which flight model, so that parameters of one can't pass for those of another.
+  add(aero != nullptr ? 1 : ball != nullptr ? 2 : 0);
+  if (aero != nullptr) {
+    for (const double value : {aero->mass, aero->radius, aero->air_density, aero->drag_coefficient,
+                               aero->magnus_coefficient, aero->spin.x, aero->spin.y, aero->spin.z,
+                               aero->time_step, aero->max_time}) {
+      add_double(value);
     }
   }
-  return vec;
+  if (ball != nullptr) {
+    add_double(ball->radius);
+  }
+  return hash;
 }
 
-struct SharedData {
-  std::queue<Eigen::Matrix<double, NX, NY>> dvs_queue;
-  std::mutex queue_mutex;
+// One stage of the fidelity schedule. The objective watches its own progress and stops the
+// optimizer early if it stops improving, so we don't burn evaluations on a grid that's too coarse
+// to tell designs apart.
+struct StageData {
+  SharedData *shared_data;
+  const ShotSet *shot_set;
+  const AeroParameters *aero;  // nullptr for drag-free flight
+  const BallParameters *ball;  // nullptr for a point mass
+  ObjectiveCache *objective_cache;
+  uint64_t cache_tag;  // from CacheTag
+  nlopt::opt *optimizer;
+  double best_objective;
+  int evals_since_improvement;
+  int computed_evals;  // evaluations that missed the cache
 };
 
-double Objective(const std::vector<double> &x, std::vector<double> &grad __attribute__((unused)),
-                 void *my_func_data) {
-  auto *shared_data = reinterpret_cast<SharedData *>(my_func_data);
+// First step of each stage of the fidelity schedule. Each finer grid still moves the design about
+// as far as the coarser one before it did (an RMS of 0.13, 0.11 and then 0.085 per stage), so the
+// step only shrinks to match that, and only in the last stage. Smaller steps cost evaluations.
+constexpr std::array<double, 3> kStageInitialSteps = {0.1, 0.1, 0.08};
+
+// Evaluations without relative improvement of kStallTol before a stage is considered stalled.
+constexpr int kStallEvals = 200;
+constexpr double kStallTol = 1e-6;
+
+// Finite differences for gradient-based algorithms, only used with the drag-free point-mass
+// objective: that one is smooth in the design variables, while rim landings and contacts put kinks
+// and jumps into the others.
+constexpr double kFiniteDifferenceStep = 1e-6;
+
+// The stage's objective at x, without the cache or any of the bookkeeping. Big shot sets are split
+// over every core.
+template <int NU, int NV>
+double ComputeObjective(const StageData &stage_data, const std::vector<double> &x) {
+  const Eigen::Matrix<glm::dvec3, NX, NY> control_points =
+      Backboard<NX, NY>::ToControlPoints(Vec2Dvs(x));
+  const int num_threads = NumThreads(0);
+  if (stage_data.aero != nullptr) {
+    return Problem<NX, NY>::AeroObjectiveFunction<NU, NV>(control_points, *stage_data.shot_set,
+                                                          *stage_data.aero, num_threads);
+  }
+  if (stage_data.ball != nullptr) {
+    return Problem<NX, NY>::FiniteBallObjectiveFunction<NU, NV>(
+        control_points, *stage_data.shot_set, *stage_data.ball, num_threads);
+  }
+  return Problem<NX, NY>::ObjectiveFunction<NU, NV>(control_points, *stage_data.shot_set,
+                                                    num_threads);
+}
+
+template <int NU, int NV>
+double Objective(const std::vector<double> &x, std::vector<double> &grad, void *my_func_data) {
+  auto *stage_data = reinterpret_cast<StageData *>(my_func_data);
+  SharedData *shared_data = stage_data->shared_data;
 
   using namespace std::chrono_literals;
   std::this_thread::sleep_for(0.01s);
@@ -73,83 +222,403 @@ double Objective(const std::vector<double> &x, std::vector<double> &grad __attri
   Eigen::Matrix<double, NX, NY> dvs = Vec2Dvs(x);
 
   // First and most importantly, send the design variables to the visualizer.
-  {
-    const std::lock_guard<std::mutex> lock(shared_data->queue_mutex);
-    shared_data->dvs_queue.push(dvs);
+  PushDvs(*shared_data, dvs);
+
+  // Now I suppose we could compute the objective, unless we already have.
+  const uint64_t cache_tag = stage_data->cache_tag;
+  // nlopt passes an empty grad to derivative-free algorithms.
+  const bool want_gradient = !grad.empty();
+  std::optional<ObjectiveCache::Entry> cached = stage_data->objective_cache->Lookup(cache_tag, x);
+  if (!cached || (want_gradient && cached->gradient.empty())) {
+    ObjectiveCache::Entry entry{
+        cached ? cached->objective : ComputeObjective<NU, NV>(*stage_data, x), {}};
+    if (want_gradient) {
+      // Central differences, one-sided at the bounds so the objective is never evaluated outside
+      // them.
+      entry.gradient.resize(x.size());
+      std::vector<double> x_step = x;
+      for (size_t i = 0; i < x.size(); i++) {
+        const double x_minus = std::max(x[i] - kFiniteDifferenceStep, kDvLowerBound);
+        const double x_plus = std::min(x[i] + kFiniteDifferenceStep, kDvUpperBound);
+        x_step[i] = x_plus;
+        const double f_plus = ComputeObjective<NU, NV>(*stage_data, x_step);
+        x_step[i] = x_minus;
+        const double f_minus =
+            x_minus == x[i] ? entry.objective : ComputeObjective<NU, NV>(*stage_data, x_step);
+        x_step[i] = x[i];
+        entry.gradient[i] = (f_plus - f_minus) / (x_plus - x_minus);
+      }
+    }
+    stage_data->objective_cache->Insert(cache_tag, x, entry);
+    cached = entry;
+    if (stage_data->computed_evals++ % kHeatmapStride == 0) {
+      RecordLandings<NU, NV>(*shared_data, dvs);
+    }
+  }
+  const double objective = cached->objective;
+  if (want_gradient) {
+    std::copy(cached->gradient.begin(), cached->gradient.end(), grad.begin());
+  }
+
+  // Stall detection.
+  if (objective < stage_data->best_objective * (1 - kStallTol)) {
+    stage_data->best_objective = objective;
+    stage_data->evals_since_improvement = 0;
+  } else {
+    stage_data->evals_since_improvement++;
+    if (stage_data->evals_since_improvement >= kStallEvals) {
+      stage_data->optimizer->force_stop();
+    }
+  }
+  if (shared_data->stop) {
+    stage_data->optimizer->force_stop();
   }
 
-  // Now I suppose we could compute the objective.
-  return Problem<NX, NY>::ObjectiveFunction<NU_OBJ, NV_OBJ>(
-      Backboard<NX, NY>::ToControlPoints(dvs));
+  return objective;
 }
 
-void Optimize(SharedData &shared_data) {
-  std::vector<double> x =
-      Dvs2Vec(Backboard<NX, NY>::FromControlPoints(Backboard<NX, NY>::Initialize()));
+// With manufacturing limits: SLSQP uses the constraints' exact Jacobians and the objective's
+// finite difference gradient, but only the drag-free point-mass objective is smooth enough for
+// that. The others go to COBYLA, which needs no derivatives.
+nlopt::algorithm ConstrainedAlgorithm(const AeroParameters *aero, const BallParameters *ball) {
+  return aero == nullptr && ball == nullptr ? nlopt::LD_SLSQP : nlopt::LN_COBYLA;
+}
 
-  nlopt::opt optimizer(nlopt::LN_NELDERMEAD, static_cast<uint>(x.size()));
+// Run the optimizer with an NU x NV bounce grid, starting from and updating x in place. With
+// manufacturing limits the design is also kept buildable at every bounce point, starting from a
+// buildable design.
+template <int NU, int NV>
+void OptimizeAtFidelity(SharedData &shared_data, const ShotSet &shot_set,
+                        const AeroParameters *aero, const BallParameters *ball,
+                        const ManufacturingLimits *limits,
+                        ObjectiveCache &objective_cache, std::vector<double> &x,
+                        const double initial_step, const double xtol_rel) {
+  if (shared_data.stop) {
+    return;
+  }
+  nlopt::opt optimizer(limits != nullptr ? ConstrainedAlgorithm(aero, ball) : nlopt::LN_NELDERMEAD,
+                       static_cast<uint>(x.size()));
   // nlopt::opt optimizer(nlopt::LN_SBPLX, static_cast<uint>(x.size()));
-  optimizer.set_lower_bounds(-10);
-  optimizer.set_upper_bounds(2);
+  optimizer.set_lower_bounds(kDvLowerBound);
+  optimizer.set_upper_bounds(kDvUpperBound);
 
-  std::vector<double> dx0(x.size(), 0.1);
+  std::vector<double> dx0(x.size(), initial_step);
   optimizer.set_initial_step(dx0);
 
   // nlopt_set_xtol_rel(optimizer, 1e-4);
-  optimizer.set_xtol_rel(1e-4);
+  optimizer.set_xtol_rel(xtol_rel);
 
-  // FunctionData data = {problem, visualization};
-  optimizer.set_min_objective(Objective, &shared_data);
+  StageData stage_data = {&shared_data, &shot_set, aero, ball, &objective_cache,
+                          CacheTag<NU, NV>(shot_set, aero, ball), &optimizer,
+                          std::numeric_limits<double>::infinity(), 0, 0};
+  optimizer.set_min_objective(Objective<NU, NV>, &stage_data);
 
-  //  opt.add_inequality_constraint(myvconstraint, &data[0], 1e-8);
-  //  opt.add_inequality_constraint(myvconstraint, &data[1], 1e-8);
-  //  std::vector<double> x(2);
-  //  x[0] = 1.234; x[1] = 5.678;
+  std::optional<ManufacturingConstraints<NX, NY>> constraints;
+  if (limits != nullptr) {
+    constraints = ManufacturingConstraints<NX, NY>::Build<NU, NV>(*limits);
+    const double scale = constraints->ScaleIntoLimits(x);
+    if (scale < 1) {
+      fprintf(stderr, "scaled the starting design by %.3f to make it buildable\n", scale);
+    }
+    optimizer.add_inequality_mconstraint(
+        ManufacturingConstraints<NX, NY>::NloptConstraint, &*constraints,
+        std::vector<double>(constraints->Size(), kManufacturingTol));
+  }
 
   double minf{};
   try {
-    fprintf(stderr, "starting optimization\n");
+    fprintf(stderr, "starting optimization with %dx%d bounce grid\n", NU, NV);
     optimizer.optimize(x, minf);
-    fprintf(stderr, "found minimum %.12f\n", minf);
-    // return EXIT_SUCCESS;
+    fprintf(stderr, "found minimum %.12f after %d evaluations\n", minf, optimizer.get_numevals());
+  } catch (nlopt::forced_stop &e) {
+    // nlopt leaves the best point found so far in x
+    fprintf(stderr, "%s after %d evaluations at %.12f\n", shared_data.stop ? "stopped" : "stalled",
+            optimizer.get_numevals(), stage_data.best_objective);
   } catch (std::exception &e) {
     std::cerr << "nlopt failed: " << e.what() << std::endl;
-    // return EXIT_FAILURE;
+  }
+  if (constraints) {
+    fprintf(stderr, "largest manufacturing constraint violation %.3g\n",
+            constraints->MaxViolation(x));
+  }
+}
+
+// Stochastic optimization: SPSA on a minibatch estimate of the objective, so the cost of an
+// iteration depends on kMinibatchSize rather than on the number of shots.
+void OptimizeStochastic(SharedData &shared_data, const ShotSet &shot_set,
+                        std::vector<double> &x) {
+  SpsaObjective minibatch_objective = [&shot_set](const std::vector<double> &x_k,
+                                                  const uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    return Problem<NX, NY>::MinibatchObjectiveFunction<NU_OBJ, NV_OBJ>(
+        Backboard<NX, NY>::ToControlPoints(Vec2Dvs(x_k)), shot_set, kMinibatchSize,
+        Problem<NX, NY>::Sampling::kStratified, rng);
+  };
+  auto callback = [&shared_data](const int iteration, const std::vector<double> &x_k) {
+    PushDvs(shared_data, Vec2Dvs(x_k));
+    if (iteration % kHeatmapStride == 0) {
+      RecordLandings<NU_OBJ, NV_OBJ>(shared_data, Vec2Dvs(x_k));
+    }
+    if (iteration % 500 == 0) {
+      fprintf(stderr, "spsa iteration %d\n", iteration);
+    }
+    return !shared_data.stop;
+  };
+
+  std::mt19937_64 rng(0);
+  SpsaOptions options;
+  options.lower_bound = kDvLowerBound;
+  options.upper_bound = kDvUpperBound;
+  fprintf(stderr, "starting spsa with minibatches of %d\n", kMinibatchSize);
+  Spsa(minibatch_objective, x, options, rng, callback);
+  fprintf(stderr, "full objective after spsa %.12f\n",
+          Problem<NX, NY>::ObjectiveFunction<NU_OBJ, NV_OBJ>(
+              Backboard<NX, NY>::ToControlPoints(Vec2Dvs(x)), shot_set, NumThreads(0)));
+}
+
+struct Options {
+  std::string objective_cache_path;
+  std::string shot_set_path;
+  bool spsa = false;
+  bool aero = false;
+  // score shots where a real ball would clip the rim or hit the board twice as misses
+  bool finite_ball = false;
+  // keep the design within ManufacturingLimits
+  bool manufacturable = false;
+  // headless rendering, to PNGs in a directory or raw RGBA frames piped to a command
+  std::string offscreen_dir;
+  std::string offscreen_pipe;
+};
+
+void Optimize(SharedData &shared_data, const ShotSet &shot_set, const Options &options) {
+  std::vector<double> x =
+      Dvs2Vec(Backboard<NX, NY>::FromControlPoints(Backboard<NX, NY>::Initialize()));
+
+  if (options.spsa) {
+    OptimizeStochastic(shared_data, shot_set, x);
+    return;
+  }
+
+  ObjectiveCache objective_cache(kObjectiveCacheCapacity, kObjectiveCacheQuantum);
+  if (!options.objective_cache_path.empty()) {
+    objective_cache.Load(options.objective_cache_path);
+  }
+
+  // Adaptive fidelity: get into the right neighborhood on a cheap, coarse bounce grid and only
+  // refine once that grid has nothing more to say. Each stage starts from the previous design.
+  const AeroParameters *aero = options.aero ? &kAeroParameters : nullptr;
+  if (aero != nullptr) {
+    CheckAeroIntegratorAgainstBounce();
+  }
+  const BallParameters ball_parameters;
+  const BallParameters *ball = options.finite_ball ? &ball_parameters : nullptr;
+  const ManufacturingLimits manufacturing_limits;
+  const ManufacturingLimits *limits = options.manufacturable ? &manufacturing_limits : nullptr;
+  OptimizeAtFidelity<6, 4>(shared_data, shot_set, aero, ball, limits, objective_cache, x,
+                           kStageInitialSteps[0], 1e-2);
+  OptimizeAtFidelity<10, 6>(shared_data, shot_set, aero, ball, limits, objective_cache, x,
+                            kStageInitialSteps[1], 1e-3);
+  OptimizeAtFidelity<NU_OBJ, NV_OBJ>(shared_data, shot_set, aero, ball, limits, objective_cache,
+                                     x, kStageInitialSteps[2], 1e-4);
+
+  fprintf(stderr,
+          "objective cache: %" PRIu64 " hits, %" PRIu64 " misses (%.1f%% hit rate), %zu entries\n",
+          objective_cache.Hits(), objective_cache.Misses(), 100 * objective_cache.HitRate(),
+          objective_cache.Size());
+  if (!options.objective_cache_path.empty()) {
+    objective_cache.Save(options.objective_cache_path);
   }
 }
 
-int run_it(char *argv0) {
+ShotSet LoadShotSet(const Options &options) {
+  ShotSet shot_set =
+      options.shot_set_path.empty() ? ShotSet::Grid() : ShotSet::Load(options.shot_set_path);
+  // every bounce grid Optimize uses
+  const double max_bounce_z = std::max({Problem<NX, NY>::MaxBounceZ<6, 4>(),
+                                        Problem<NX, NY>::MaxBounceZ<10, 6>(),
+                                        Problem<NX, NY>::MaxBounceZ<NU_OBJ, NV_OBJ>()});
+  Problem<NX, NY>::CheckShotsBelowBounces(shot_set, max_bounce_z, options.shot_set_path);
+  fprintf(stderr, "optimizing over %zu shot points\n", shot_set.Size());
+  return shot_set;
+}
+
+// The newest design the optimizer has sent, if there's one we haven't seen yet.
+std::optional<Eigen::Matrix<double, NX, NY>> PopNewestDvs(SharedData &shared_data) {
+  // drain the queue
+  std::optional<Eigen::Matrix<double, NX, NY>> dvs = std::nullopt;
+  const std::lock_guard<std::mutex> lock(shared_data.queue_mutex);
+  while (shared_data.dvs_queue.size() > 1) {
+    shared_data.dvs_queue.pop();
+  }
+  if (!shared_data.dvs_queue.empty()) {
+    dvs = shared_data.dvs_queue.front();
+    shared_data.dvs_queue.pop();
+  }
+  return dvs;
+}
+
+// How many keys and mouse buttons are down. The camera moves for as long as one is held, so the
+// window can't sit idle then. Counted by callbacks chained in front of the window's own, which
+// only ever run on the main thread. GLFW releases whatever is held when the window loses focus.
+static int inputs_held = 0;
+static GLFWkeyfun window_key_callback = nullptr;
+static GLFWmousebuttonfun window_mouse_button_callback = nullptr;
+
+static void CountPressOrRelease(const int action) {
+  if (action == GLFW_PRESS) {
+    inputs_held++;
+  } else if (action == GLFW_RELEASE) {
+    // A key may have gone down before the callbacks were installed.
+    inputs_held = std::max(0, inputs_held - 1);
+  }
+}
+
+static void KeyCallback(GLFWwindow *window, const int key, const int scancode, const int action,
+                        const int mods) {
+  CountPressOrRelease(action);
+  if (window_key_callback != nullptr) {
+    window_key_callback(window, key, scancode, action, mods);
+  }
+}
+
+static void MouseButtonCallback(GLFWwindow *window, const int button, const int action,
+                                const int mods) {
+  CountPressOrRelease(action);
+  if (window_mouse_button_callback != nullptr) {
+    window_mouse_button_callback(window, button, action, mods);
+  }
+}
+
+// Chain the counting callbacks in front of the ones Window::Run installed.
+static void TrackInputsHeld(GLFWwindow *window) {
+  window_key_callback = glfwSetKeyCallback(window, KeyCallback);
+  window_mouse_button_callback = glfwSetMouseButtonCallback(window, MouseButtonCallback);
+}
+
+// Headless mode: render a frame for every new design to an offscreen framebuffer and encode them
+// in the background, until the optimizer finishes.
+int run_offscreen(const Options &options) {
+  const bool png = !options.offscreen_dir.empty();
+  if (png) {
+    std::filesystem::create_directories(options.offscreen_dir);
+  } else {
+    // If the encoder exits early, fail the write with EPIPE and report it rather than getting
+    // killed in the middle of a frame.
+    signal(SIGPIPE, SIG_IGN);
+  }
+  FrameEncoderPool encoder(
+      png ? FrameEncoderPool::Format::kPng : FrameEncoderPool::Format::kRawVideo,
+      png ? options.offscreen_dir : options.offscreen_pipe,
+      static_cast<int>(std::max(1U, std::thread::hardware_concurrency() / 2)), kMaxQueuedFrames);
+  OffscreenRenderer renderer(kOffscreenWidth, kOffscreenHeight, encoder);
+
+  // problem, now that there's a context to upload it to
+  const ShotSet shot_set = LoadShotSet(options);
+  const ShotSet drawn_shot_set = shot_set.Subsample(kMaxDrawnShots);
+  ProblemVisualization visualization;
+  visualization.SetAero(options.aero ? &kAeroParameters : nullptr);
+
+  // A fixed camera from the free throw line, a bit to the side and above the rim. z is down.
+  const glm::mat4 view = glm::lookAt(glm::vec3(3.5F, 7.0F, -4.5F), glm::vec3(0.0F, 0.5F, -3.2F),
+                                     glm::vec3(0.0F, 0.0F, -1.0F));
+  const glm::mat4 proj = glm::perspective(
+      glm::radians(45.0F),
+      static_cast<float>(renderer.Width()) / static_cast<float>(renderer.Height()), 0.1F, 100.0F);
+
+  auto render = [&renderer, &visualization, &view, &proj]() {
+    renderer.BeginFrame();
+    visualization.Draw(view, proj);
+    renderer.EndFrame();
+  };
+  visualization.Update<NU_OBJ, NV_OBJ, NU_VIS, NU_VIS>(Backboard<NX, NY>::Initialize(),
+                                                       drawn_shot_set);
+  render();
+
+  SharedData shared_data;
+  std::thread thread_object([&shared_data, &shot_set, &options]() {
+    Optimize(shared_data, shot_set, options);
+    shared_data.optimization_done = true;
+  });
+
+  using namespace std::chrono_literals;
+  try {
+    for (;;) {
+      // Check before draining so the final design always makes it into a frame.
+      const bool done = shared_data.optimization_done;
+      std::optional<Eigen::Matrix<double, NX, NY>> dvs = PopNewestDvs(shared_data);
+      if (dvs) {
+        visualization.Update<NU_OBJ, NV_OBJ, NU_VIS, NU_VIS>(
+            Backboard<NX, NY>::ToControlPoints(*dvs), drawn_shot_set);
+        render();
+      } else if (done) {
+        break;
+      } else {
+        std::this_thread::sleep_for(5ms);
+      }
+    }
+  } catch (...) {
+    // Destroying a joinable thread calls std::terminate, so stop the optimizer and let it return
+    // first.
+    shared_data.stop = true;
+    thread_object.join();
+    throw;
+  }
+  thread_object.join();
+  renderer.Flush();
+  fprintf(stderr, "rendered %d frames\n", encoder.FramesWritten());
+
+  return EXIT_SUCCESS;
+}
+
+int run_it(char *argv0, const Options &options) {
   // Boilerplate
   bb3d::Window window(argv0);
 
   // problem
+  const ShotSet shot_set = LoadShotSet(options);
+  // There's no point drawing every shot of a big shot set.
+  const ShotSet drawn_shot_set = shot_set.Subsample(kMaxDrawnShots);
   ProblemVisualization visualization;
-  visualization.Update<NU_OBJ, NV_OBJ, NU_VIS, NU_VIS>(Backboard<NX, NY>::Initialize());
+  visualization.SetAero(options.aero ? &kAeroParameters : nullptr);
+  visualization.Update<NU_OBJ, NV_OBJ, NU_VIS, NU_VIS>(Backboard<NX, NY>::Initialize(),
+                                                       drawn_shot_set);
 
   // it's theadn' time
   SharedData shared_data;
-  std::thread thread_object([&shared_data]() { Optimize(shared_data); });
+  shared_data.post_empty_event = true;
+  shared_data.heatmap_shot_set = &drawn_shot_set;
+  shared_data.heatmap_aero = options.aero ? &kAeroParameters : nullptr;
+  visualization.SetLandingHeatmap(&shared_data.landing_heatmap);
+  std::thread thread_object(
+      [&shared_data, &shot_set, &options]() { Optimize(shared_data, shot_set, options); });
 
   std::function<void(key_t)> handle_keypress = [&visualization](key_t key) {
     visualization.HandleKeyPress(key);
   };
 
-  std::function<void()> update_visualization = [&visualization, &shared_data]() {
-    // drain the queue
-    std::optional<Eigen::Matrix<double, NX, NY>> dvs = std::nullopt;
-    {
-      const std::lock_guard<std::mutex> lock(shared_data.queue_mutex);
-      while (shared_data.dvs_queue.size() > 1) {
-        shared_data.dvs_queue.pop();
-      }
-      if (!shared_data.dvs_queue.empty()) {
-        dvs = shared_data.dvs_queue.front();
-        shared_data.dvs_queue.pop();
-      }
-    }
+  auto update_from_queue = [&visualization, &shared_data, &drawn_shot_set]() {
+    std::optional<Eigen::Matrix<double, NX, NY>> dvs = PopNewestDvs(shared_data);
     if (dvs) {
-      visualization.Update<NU_OBJ, NV_OBJ, NU_VIS, NU_VIS>(
-          Backboard<NX, NY>::ToControlPoints(*dvs));
+      visualization.Update<NU_OBJ, NV_OBJ, NU_VIS, NU_VIS>(Backboard<NX, NY>::ToControlPoints(*dvs),
+                                                           drawn_shot_set);
+    }
+  };
+
+  // Called once a frame before drawing. When there's no new design, no toggle has changed and
+  // nothing is held down, block until there's input, the optimizer posts a design, or it's been a
+  // while, instead of redrawing the same frame as fast as the window allows.
+  bool tracking_inputs = false;
+  std::function<void()> update_visualization = [&visualization, &update_from_queue,
+                                                &tracking_inputs]() {
+    // Window::Run sets its input callbacks before the first frame.
+    if (!tracking_inputs) {
+      TrackInputsHeld(glfwGetCurrentContext());
+      tracking_inputs = true;
+    }
+    update_from_queue();
+    if (!visualization.Dirty() && inputs_held == 0) {
+      glfwWaitEventsTimeout(kIdleRedrawPeriod);
+      update_from_queue();
     }
   };
 
@@ -158,14 +627,87 @@ int run_it(char *argv0) {
         visualization.Draw(view, proj);
       };
 
-  window.Run(handle_keypress, update_visualization, draw_visualization);
+  // The window terminates GLFW when it's destroyed, so the optimizer has to be stopped before then,
+  // and mustn't post events to it after the event loop is done.
+  auto stop_optimizer = [&shared_data, &thread_object]() {
+    {
+      const std::lock_guard<std::mutex> lock(shared_data.queue_mutex);
+      shared_data.post_empty_event = false;
+    }
+    shared_data.stop = true;
+    thread_object.join();
+  };
+  try {
+    window.Run(handle_keypress, update_visualization, draw_visualization);
+  } catch (...) {
+    stop_optimizer();
+    throw;
+  }
+  stop_optimizer();
 
   return EXIT_SUCCESS;
 }
 
-int main(int argc __attribute__((unused)), char *argv[] __attribute__((unused))) {
+int main(int argc, char *argv[]) {
+  // usage: vis [--objective-cache=PATH] [--shot-set=PATH]
+  //            [--spsa | [--aero | --finite-ball] --manufacturable]
+  //            [--offscreen=DIR | --offscreen-pipe=COMMAND]
+  const std::string objective_cache_flag = "--objective-cache=";
+  const std::string shot_set_flag = "--shot-set=";
+  const std::string offscreen_flag = "--offscreen=";
+  const std::string offscreen_pipe_flag = "--offscreen-pipe=";
+  Options options;
+  for (int k = 1; k < argc; k++) {
+    const std::string arg = argv[k];
+    if (arg.rfind(objective_cache_flag, 0) == 0) {
+      options.objective_cache_path = arg.substr(objective_cache_flag.size());
+    } else if (arg.rfind(shot_set_flag, 0) == 0) {
+      options.shot_set_path = arg.substr(shot_set_flag.size());
+    } else if (arg.rfind(offscreen_flag, 0) == 0) {
+      options.offscreen_dir = arg.substr(offscreen_flag.size());
+    } else if (arg.rfind(offscreen_pipe_flag, 0) == 0) {
+      options.offscreen_pipe = arg.substr(offscreen_pipe_flag.size());
+    } else if (arg == "--spsa") {
+      options.spsa = true;
+    } else if (arg == "--aero") {
+      options.aero = true;
+    } else if (arg == "--finite-ball") {
+      options.finite_ball = true;
+    } else if (arg == "--manufacturable") {
+      options.manufacturable = true;
+    } else {
+      std::cerr << "unrecognized argument: " << arg << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (options.spsa && options.aero) {
+    std::cerr << "--aero is only supported by the deterministic optimizer, not --spsa" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (options.finite_ball && (options.spsa || options.aero)) {
+    std::cerr << "--finite-ball is only supported by the deterministic optimizer without --aero"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (options.spsa && options.manufacturable) {
+    std::cerr << "--manufacturable is only supported by the deterministic optimizer, not --spsa"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (!options.offscreen_dir.empty() && !options.offscreen_pipe.empty()) {
+    std::cerr << "pick one of --offscreen and --offscreen-pipe" << std::endl;
+    return EXIT_FAILURE;
+  }
+
   try {
-    run_it(argv[0]);
+    if (!options.offscreen_dir.empty() || !options.offscreen_pipe.empty()) {
+      return run_offscreen(options);
+    }
+    run_it(argv[0], options);
   } catch (const std::exception &e) {
     std::cerr << e.what();
   }
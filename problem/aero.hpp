@@ -0,0 +1,294 @@
+#pragma once
+
+#include <algorithm>    // for min
+#include <array>        // for array
+#include <cmath>        // for sqrt, M_PI
+#include <cstddef>      // for size_t
+#include <glm/glm.hpp>  // for dvec3, length, normalize
+#include <utility>      // for move
+#include <vector>       // for vector
+
+#include "bb3d/assert.hpp"   // for ASSERT
+#include "problem/hoop.hpp"  // for Hoop, Hoop::kRimHeight
+#include "problem/shot.hpp"  // for Bounce, Sample, g_accel
+
+// Ball flight with aerodynamic drag and Magnus lift, for when a parabola isn't good enough.
+//
+// There's no closed form, so trajectories are integrated with fixed step RK4. Trajectories are
+// integrated kLanes at a time in structure-of-arrays form with branch-free inner loops so the
+// compiler can vectorize across lanes. A trajectory ends when it comes down through its target
+// height, which is located inside the final step by cubic Hermite interpolation.
+struct AeroParameters {
+  // size 7 ball
+  double mass = 0.62;     // kg
+  double radius = 0.119;  // m
+  double air_density = 1.2;
+  double drag_coefficient = 0.54;
+  // Magnus force is 0.5 * rho * area * radius * magnus_coefficient * (spin x velocity).
+  double magnus_coefficient = 1.0;
+  // Spin after the bounce, rad/s, in the problem frame.
+  glm::dvec3 spin = {0, 0, 0};
+
+  double time_step = 0.005;  // s
+  double max_time = 3;       // s, give up on trajectories that never come down
+
+  [[nodiscard]] double DragPerMass() const {
+    return 0.5 * air_density * drag_coefficient * M_PI * radius * radius / mass;
+  }
+  [[nodiscard]] double MagnusPerMass() const {
+    return 0.5 * air_density * M_PI * radius * radius * radius * magnus_coefficient / mass;
+  }
+};
+
+class AeroIntegrator {
+ public:
+  static constexpr int kLanes = 8;
+
+  explicit AeroIntegrator(const AeroParameters &parameters)
+      : time_step_(parameters.time_step),
+        max_steps_(static_cast<int>(parameters.max_time / parameters.time_step) + 1),
+        drag_(parameters.DragPerMass()),
+        magnus_x_(parameters.MagnusPerMass() * parameters.spin.x),
+        magnus_y_(parameters.MagnusPerMass() * parameters.spin.y),
+        magnus_z_(parameters.MagnusPerMass() * parameters.spin.z) {
+    ASSERT(parameters.time_step > 0);
+  }
+
+  // Where the ball leaving the backboard at each (position, velocity) comes down through the rim
+  // plane. Like Bounce, trajectories that start below the rim fall to the floor instead.
+  // through_rim says which trajectories did come down through the rim plane. The others either
+  // fell to the floor, or were still in the air after max_time and are left where they were then.
+  // If paths isn't null it also gets each trajectory, one point per time step, for drawing.
+  void LandingPoints(const std::vector<glm::dvec3> &positions,
+                     const std::vector<glm::dvec3> &velocities,
+                     std::vector<glm::dvec3> &landing_points, std::vector<bool> &through_rim,
+                     std::vector<std::vector<glm::dvec3> > *paths = nullptr) const {
+    ASSERT(positions.size() == velocities.size());
+    landing_points.resize(positions.size());
+    through_rim.resize(positions.size());
+    std::array<std::vector<glm::dvec3>, kLanes> lane_paths;
+    if (paths != nullptr) {
+      paths->resize(positions.size());
+    }
+    for (size_t start = 0; start < positions.size(); start += kLanes) {
+      const size_t count = std::min(positions.size() - start, static_cast<size_t>(kLanes));
+      State state{};
+      Lanes target{};
+      for (size_t k = 0; k < kLanes; k++) {
+        // Pad the last batch by repeating its first trajectory.
+        const size_t index = k < count ? start + k : start;
+        const glm::dvec3 &p = positions[index];
+        const glm::dvec3 &v = velocities[index];
+        state.px.at(k) = p.x;
+        state.py.at(k) = p.y;
+        state.pz.at(k) = p.z;
+        state.vx.at(k) = v.x;
+        state.vy.at(k) = v.y;
+        state.vz.at(k) = v.z;
+        target.at(k) = p.z < -Hoop::kRimHeight ? -Hoop::kRimHeight : 0;
+      }
+      const std::array<bool, kLanes> landed =
+          IntegrateToTarget(state, target, paths != nullptr ? &lane_paths : nullptr);
+      for (size_t k = 0; k < count; k++) {
+        landing_points[start + k] = {state.px.at(k), state.py.at(k), state.pz.at(k)};
+        through_rim[start + k] = landed.at(k) && target.at(k) == -Hoop::kRimHeight;
+        if (paths != nullptr) {
+          (*paths)[start + k] = std::move(lane_paths.at(k));
+        }
+      }
+    }
+  }
+
+ private:
+  using Lanes = std::array<double, kLanes>;
+  struct State {
+    Lanes px, py, pz, vx, vy, vz;
+  };
+
+  // d/dt of state, into derivative. z points down so gravity is +z.
+  void Derivative(const State &state, State &derivative) const {
+    for (int k = 0; k < kLanes; k++) {
+      const double vx = state.vx[k];
+      const double vy = state.vy[k];
+      const double vz = state.vz[k];
+      const double speed = std::sqrt(vx * vx + vy * vy + vz * vz);
+      derivative.px[k] = vx;
+      derivative.py[k] = vy;
+      derivative.pz[k] = vz;
+      derivative.vx[k] = -drag_ * speed * vx + (magnus_y_ * vz - magnus_z_ * vy);
+      derivative.vy[k] = -drag_ * speed * vy + (magnus_z_ * vx - magnus_x_ * vz);
+      derivative.vz[k] = g_accel - drag_ * speed * vz + (magnus_x_ * vy - magnus_y_ * vx);
+    }
+  }
+
+  // out = state + h * derivative
+  static void Axpy(const State &state, const double h, const State &derivative, State &out) {
+    for (int k = 0; k < kLanes; k++) {
+      out.px[k] = state.px[k] + h * derivative.px[k];
+      out.py[k] = state.py[k] + h * derivative.py[k];
+      out.pz[k] = state.pz[k] + h * derivative.pz[k];
+      out.vx[k] = state.vx[k] + h * derivative.vx[k];
+      out.vy[k] = state.vy[k] + h * derivative.vy[k];
+      out.vz[k] = state.vz[k] + h * derivative.vz[k];
+    }
+  }
+
+  // Step every lane until each has come down through its target. On return, state holds each
+  // lane's position and velocity at its target height. Lanes that have already landed keep being
+  // stepped with the rest (that's cheaper than breaking up the vector loops) but aren't updated.
+  // Returns which lanes landed; the others ran out of time and hold their state at max_time.
+  // lane_paths, if not null, gets each lane's positions from the start to where it ends up.
+  std::array<bool, kLanes> IntegrateToTarget(
+      State &state, const Lanes &target,
+      std::array<std::vector<glm::dvec3>, kLanes> *lane_paths = nullptr) const {
+    const double h = time_step_;
+    std::array<bool, kLanes> active{};
+    active.fill(true);
+    if (lane_paths != nullptr) {
+      for (int k = 0; k < kLanes; k++) {
+        lane_paths->at(k).assign(1, {state.px[k], state.py[k], state.pz[k]});
+      }
+    }
+    State k1{};
+    State k2{};
+    State k3{};
+    State k4{};
+    State tmp{};
+    State next{};
+    for (int step = 0; step < max_steps_; step++) {
+      Derivative(state, k1);
+      Axpy(state, 0.5 * h, k1, tmp);
+      Derivative(tmp, k2);
+      Axpy(state, 0.5 * h, k2, tmp);
+      Derivative(tmp, k3);
+      Axpy(state, h, k3, tmp);
+      Derivative(tmp, k4);
+      for (int k = 0; k < kLanes; k++) {
+        // clang-format off
+        next.px[k] = state.px[k] + h / 6 * (k1.px[k] + 2 * k2.px[k] + 2 * k3.px[k] + k4.px[k]);
+        next.py[k] = state.py[k] + h / 6 * (k1.py[k] + 2 * k2.py[k] + 2 * k3.py[k] + k4.py[k]);
+        next.pz[k] = state.pz[k] + h / 6 * (k1.pz[k] + 2 * k2.pz[k] + 2 * k3.pz[k] + k4.pz[k]);
+        next.vx[k] = state.vx[k] + h / 6 * (k1.vx[k] + 2 * k2.vx[k] + 2 * k3.vx[k] + k4.vx[k]);
+        next.vy[k] = state.vy[k] + h / 6 * (k1.vy[k] + 2 * k2.vy[k] + 2 * k3.vy[k] + k4.vy[k]);
+        next.vz[k] = state.vz[k] + h / 6 * (k1.vz[k] + 2 * k2.vz[k] + 2 * k3.vz[k] + k4.vz[k]);
+        // clang-format on
+      }
+
+      // Event detection. This is scalar, but each lane only lands once.
+      int num_active = 0;
+      for (int k = 0; k < kLanes; k++) {
+        if (!active.at(k)) {
+          continue;
+        }
+        if (next.vz[k] > 0 && next.pz[k] >= target[k]) {
+          const double s = CrossingFraction(state, next, k, target[k], h);
+          const double s2 = s * s;
+          const double s3 = s2 * s;
+          const double h00 = 2 * s3 - 3 * s2 + 1;
+          const double h10 = s3 - 2 * s2 + s;
+          const double h01 = -2 * s3 + 3 * s2;
+          const double h11 = s3 - s2;
+          state.px[k] = h00 * state.px[k] + h10 * h * state.vx[k] + h01 * next.px[k] +
+                        h11 * h * next.vx[k];
+          state.py[k] = h00 * state.py[k] + h10 * h * state.vy[k] + h01 * next.py[k] +
+                        h11 * h * next.vy[k];
+          state.pz[k] = target[k];
+          state.vx[k] += s * (next.vx[k] - state.vx[k]);
+          state.vy[k] += s * (next.vy[k] - state.vy[k]);
+          state.vz[k] += s * (next.vz[k] - state.vz[k]);
+          active.at(k) = false;
+        } else {
+          state.px[k] = next.px[k];
+          state.py[k] = next.py[k];
+          state.pz[k] = next.pz[k];
+          state.vx[k] = next.vx[k];
+          state.vy[k] = next.vy[k];
+          state.vz[k] = next.vz[k];
+          num_active++;
+        }
+        if (lane_paths != nullptr) {
+          lane_paths->at(k).emplace_back(state.px[k], state.py[k], state.pz[k]);
+        }
+      }
+      if (num_active == 0) {
+        break;
+      }
+    }
+    std::array<bool, kLanes> landed{};
+    for (int k = 0; k < kLanes; k++) {
+      landed.at(k) = !active.at(k);
+    }
+    return landed;
+  }
+
+  // Fraction of the step [0, 1] at which the cubic Hermite interpolant of z between state and
+  // next reaches target. A few Newton iterations from the linear guess are plenty.
+  static double CrossingFraction(const State &state, const State &next, const int k,
+                                 const double target, const double h) {
+    const double z0 = state.pz[k];
+    const double z1 = next.pz[k];
+    const double dz0 = h * state.vz[k];
+    const double dz1 = h * next.vz[k];
+    double s = z1 > z0 ? (target - z0) / (z1 - z0) : 1;
+    for (int iteration = 0; iteration < 4; iteration++) {
+      const double s2 = s * s;
+      const double s3 = s2 * s;
+      const double z = (2 * s3 - 3 * s2 + 1) * z0 + (s3 - 2 * s2 + s) * dz0 +
+                       (-2 * s3 + 3 * s2) * z1 + (s3 - s2) * dz1;
+      const double dz_ds = (6 * s2 - 6 * s) * z0 + (3 * s2 - 4 * s + 1) * dz0 +
+                           (-6 * s2 + 6 * s) * z1 + (3 * s2 - 2 * s) * dz1;
+      if (dz_ds <= 0) {
+        break;
+      }
+      s -= (z - target) / dz_ds;
+    }
+    return s < 0 ? 0 : (s > 1 ? 1 : s);
+  }
+
+  double time_step_;
+  int max_steps_;
+  double drag_;
+  double magnus_x_;
+  double magnus_y_;
+  double magnus_z_;
+};
+
+// Without air the integrated flight is a parabola again, and RK4 and the cubic Hermite crossing
+// are both exact for parabolas, so the integrator has to land where Bounce does, above and below
+// the rim. Cheap enough to run every time before trusting the integrator with an optimization.
+inline void CheckAeroIntegratorAgainstBounce() {
+  AeroParameters parameters;
+  parameters.air_density = 0;
+  const AeroIntegrator integrator(parameters);
+
+  const std::vector<glm::dvec3> shot_points = {
+      {0, 4.6, -2.0}, {-3.0, 6.0, -2.2}, {2.0, 2.0, -1.8}, {4.5, 0.8, -2.5}};
+  // the last two are below the rim, so the ball falls to the floor
+  const std::vector<glm::dvec3> bounce_points = {
+      {0, 0, -3.5}, {0.5, 0.1, -3.8}, {-0.4, -0.05, -3.3}, {0.3, 0, -2.9}, {-0.6, 0.2, -2.7}};
+  const std::vector<glm::dvec3> normals = {{0, 1, 0},
+                                           glm::normalize(glm::dvec3(0.3, 1, -0.2)),
+                                           glm::normalize(glm::dvec3(-0.5, 1, 0.4))};
+
+  std::vector<Bounce> bounces;
+  std::vector<glm::dvec3> positions;
+  std::vector<glm::dvec3> velocities;
+  for (const glm::dvec3 &shot_point : shot_points) {
+    for (const glm::dvec3 &bounce_point : bounce_points) {
+      for (const glm::dvec3 &normal : normals) {
+        const Sample sample(shot_point, bounce_point, normal);
+        bounces.push_back(sample.bounce_);
+        positions.push_back(bounce_point);
+        velocities.push_back(sample.bounce_.outgoing_velocity_);
+      }
+    }
+  }
+
+  std::vector<glm::dvec3> landing_points;
+  std::vector<bool> through_rim;
+  integrator.LandingPoints(positions, velocities, landing_points, through_rim);
+  for (size_t k = 0; k < bounces.size(); k++) {
+    ASSERT(through_rim[k] == !bounces[k].lower_than_hoop_);
+    ASSERT(glm::length(landing_points[k] - bounces[k].landing_point_) < 1e-9);
+  }
+}
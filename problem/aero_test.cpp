@@ -0,0 +1,156 @@
+#include <cmath>        // for fabs, sqrt
+#include <cstddef>      // for size_t
+#include <cstdio>       // for fprintf, stderr
+#include <cstdlib>      // for EXIT_SUCCESS
+#include <glm/glm.hpp>  // for dvec3, length
+#include <vector>       // for vector
+
+#include "bb3d/assert.hpp"        // for ASSERT
+#include "problem/aero.hpp"       // for AeroIntegrator, AeroParameters, CheckAeroIntegratorAgai...
+#include "problem/backboard.hpp"  // for Backboard
+#include "problem/config.hpp"     // for NX, NY
+#include "problem/hoop.hpp"       // for Hoop, Hoop::kRimHeight
+#include "problem/problem.hpp"    // for Problem
+#include "problem/shot.hpp"       // for Sample
+#include "problem/shot_set.hpp"   // for ShotSet
+
+// A coarse surface keeps the number of trajectories down.
+constexpr int NU = 6;
+constexpr int NV = 4;
+
+static ShotSet SmallGrid() {
+  return ShotSet::FromPoints({{0, 4.6, -2.0}, {-3.0, 6.0, -2.2}, {2.0, 2.0, -1.8}});
+}
+
+// Without air, the integrated flights land where the closed form says, and score the same.
+static void TestZeroDensity() {
+  CheckAeroIntegratorAgainstBounce();
+
+  AeroParameters aero;
+  aero.air_density = 0;
+  const ShotSet shot_set = SmallGrid();
+  const auto control_points = Backboard<NX, NY>::Initialize();
+  const std::vector<Sample> samples =
+      Problem<NX, NY>::ComputeShots<NU, NV>(control_points, shot_set);
+  const std::vector<glm::dvec3> landings =
+      Problem<NX, NY>::ComputeAeroLandings<NU, NV>(control_points, shot_set, aero);
+  ASSERT(landings.size() == samples.size());
+  for (size_t k = 0; k < samples.size(); k++) {
+    ASSERT(glm::length(landings[k] - samples[k].bounce_.landing_point_) < 1e-9);
+  }
+
+  const double expected = Problem<NX, NY>::ObjectiveFunction<NU, NV>(control_points, shot_set);
+  const double objective =
+      Problem<NX, NY>::AeroObjectiveFunction<NU, NV>(control_points, shot_set, aero);
+  ASSERT(std::fabs(objective - expected) < 1e-9 * expected);
+}
+
+// Horizontal distance covered from the bounce point to the rim plane.
+static double Carry(const glm::dvec3 &position, const glm::dvec3 &landing) {
+  const glm::dvec3 delta = landing - position;
+  return std::sqrt(delta.x * delta.x + delta.y * delta.y);
+}
+
+static void TestDragAndSpin() {
+  const std::vector<glm::dvec3> positions = {{0, 0, -3.5}, {0.4, 0.1, -3.8}};
+  const std::vector<glm::dvec3> velocities = {{0, 3, -2}, {0, 5, -1}};
+  std::vector<glm::dvec3> still_air;
+  std::vector<glm::dvec3> landings;
+  std::vector<bool> through_rim;
+
+  AeroParameters no_air;
+  no_air.air_density = 0;
+  AeroIntegrator(no_air).LandingPoints(positions, velocities, still_air, through_rim);
+  const AeroParameters drag;
+  AeroIntegrator(drag).LandingPoints(positions, velocities, landings, through_rim);
+  for (size_t k = 0; k < positions.size(); k++) {
+    ASSERT(through_rim[k]);
+    ASSERT(Carry(positions[k], landings[k]) < Carry(positions[k], still_air[k]));
+  }
+
+  // Spin about the vertical pushes the ball sideways, the other way when it's reversed, and the
+  // two flights mirror each other exactly.
+  AeroParameters spin = drag;
+  spin.spin = {0, 0, 20};
+  std::vector<glm::dvec3> left;
+  AeroIntegrator(spin).LandingPoints(positions, velocities, left, through_rim);
+  spin.spin = -spin.spin;
+  std::vector<glm::dvec3> right;
+  AeroIntegrator(spin).LandingPoints(positions, velocities, right, through_rim);
+  for (size_t k = 0; k < positions.size(); k++) {
+    ASSERT(left[k].x - positions[k].x < -0.01);
+    ASSERT(std::fabs((left[k].x - positions[k].x) + (right[k].x - positions[k].x)) < 1e-12);
+    ASSERT(std::fabs(left[k].y - right[k].y) < 1e-12);
+  }
+
+  // RK4 has converged at the default step.
+  AeroParameters fine = drag;
+  fine.time_step /= 4;
+  std::vector<glm::dvec3> fine_landings;
+  AeroIntegrator(fine).LandingPoints(positions, velocities, fine_landings, through_rim);
+  for (size_t k = 0; k < positions.size(); k++) {
+    ASSERT(glm::length(fine_landings[k] - landings[k]) < 1e-6);
+  }
+}
+
+// Balls that start below the rim fall to the floor, and balls still flying at max_time stop there.
+static void TestMisses() {
+  const std::vector<glm::dvec3> positions = {{0, 0, -2.5}, {0, 0, -3.5}};
+  const std::vector<glm::dvec3> velocities = {{0, 2, -1}, {0, 1, -12}};
+  std::vector<glm::dvec3> landings;
+  std::vector<bool> through_rim;
+  AeroParameters aero;
+  AeroIntegrator(aero).LandingPoints(positions, velocities, landings, through_rim);
+  ASSERT(!through_rim[0]);
+  ASSERT(landings[0].z == 0);
+  ASSERT(through_rim[1]);
+
+  aero.max_time = 0.5;
+  AeroIntegrator(aero).LandingPoints(positions, velocities, landings, through_rim);
+  ASSERT(!through_rim[0]);
+  ASSERT(landings[0].z < 0);
+  ASSERT(!through_rim[1]);
+  ASSERT(landings[1].z < -Hoop::kRimHeight);
+}
+
+// Paths run from the bounce point to the landing point in steps no longer than the ball's speed
+// allows, including for the lanes of a ragged last batch.
+static void TestPaths() {
+  const AeroParameters aero;
+  std::vector<glm::dvec3> positions;
+  std::vector<glm::dvec3> velocities;
+  for (int k = 0; k < AeroIntegrator::kLanes + 3; k++) {
+    positions.emplace_back(0.1 * k - 0.5, 0, -3.5);
+    velocities.emplace_back(0.2 * k - 1, 4, -1 - 0.1 * k);
+  }
+  std::vector<glm::dvec3> landings;
+  std::vector<bool> through_rim;
+  std::vector<std::vector<glm::dvec3> > paths;
+  AeroIntegrator(aero).LandingPoints(positions, velocities, landings, through_rim, &paths);
+  ASSERT(paths.size() == positions.size());
+  for (size_t k = 0; k < paths.size(); k++) {
+    ASSERT(through_rim[k]);
+    ASSERT(paths[k].size() > 2);
+    ASSERT(paths[k].front() == positions[k]);
+    ASSERT(paths[k].back() == landings[k]);
+    // the ball never gets faster than its launch speed plus what gravity adds over the flight
+    const double max_step = (glm::length(velocities[k]) + 10) * aero.time_step;
+    for (size_t step = 1; step < paths[k].size(); step++) {
+      ASSERT(glm::length(paths[k][step] - paths[k][step - 1]) <= max_step);
+    }
+  }
+
+  // asking for paths doesn't change where anything lands
+  std::vector<glm::dvec3> without_paths;
+  AeroIntegrator(aero).LandingPoints(positions, velocities, without_paths, through_rim);
+  ASSERT(without_paths == landings);
+}
+
+int main() {
+  TestZeroDensity();
+  TestDragAndSpin();
+  TestMisses();
+  TestPaths();
+  fprintf(stderr, "aero tests passed\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <algorithm>    // for clamp, max, min, upper_bound
+#include <array>        // for array
+#include <cmath>        // for ceil, fabs, isinf, sqrt
+#include <cstddef>      // for ptrdiff_t, size_t
+#include <glm/glm.hpp>  // for dvec3, length
+#include <limits>       // for numeric_limits
+
+#include "bb3d/assert.hpp"   // for ASSERT
+#include "bspline.hpp"       // for Surface
+#include "problem/hoop.hpp"  // for Hoop
+#include "problem/shot.hpp"  // for Bounce, g_accel
+
+struct BallParameters {
+  double radius = 0.1194;  // size 7, 29.5" around
+};
+
+enum class Contact {
+  kNone,
+  kRim,
+  kBoard,
+};
+
+// Contacts the point-mass model ignores on the way from the backboard down to the hoop: a ball of
+// finite radius hitting the rim, or hitting the board a second time.
+//
+// Bounce points are taken as where the ball's center is when it touches the board, so the center
+// follows Bounce's trajectory exactly and touching the board again means the center gets back to
+// the bounce surface. The board is the NU x NV bounce grid, interpolated bilinearly, which is easy
+// because x only varies along u and z only along v.
+//
+// Both tests reject almost every sample before doing any real work. For the rim, the ball has to
+// be within reach of the rim plane while its horizontal path crosses the annulus around the rim;
+// only then is its distance to the rim sampled along the path. For the board, the ball has to be
+// able to close the gap to it at all, given how fast it moves and how steep the board gets; then it
+// is marched towards the board in steps that can't skip over it.
+template <int NU, int NV>
+class BallCollisions {
+ public:
+  BallCollisions(const Surface<NU, NV> &surface, const BallParameters &ball)
+      : surface_(surface), radius_(ball.radius) {
+    for (int ku = 0; ku < NU; ku++) {
+      xs_[static_cast<size_t>(ku)] = surface.position(ku, 0).x;
+    }
+    for (int kv = 0; kv < NV; kv++) {
+      zs_[static_cast<size_t>(kv)] = surface.position(0, kv).z;
+    }
+    max_y_ = -std::numeric_limits<double>::infinity();
+    max_slope_ = 0;
+    for (int ku = 0; ku < NU; ku++) {
+      for (int kv = 0; kv < NV; kv++) {
+        const double y = surface.position(ku, kv).y;
+        max_y_ = std::max(max_y_, y);
+        if (ku > 0) {
+          ASSERT(xs_[static_cast<size_t>(ku)] > xs_[static_cast<size_t>(ku - 1)]);
+          max_slope_ = std::max(max_slope_, fabs(y - surface.position(ku - 1, kv).y) /
+                                                (xs_[static_cast<size_t>(ku)] -
+                                                 xs_[static_cast<size_t>(ku - 1)]));
+        }
+        if (kv > 0) {
+          ASSERT(zs_[static_cast<size_t>(kv)] > zs_[static_cast<size_t>(kv - 1)]);
+          max_slope_ = std::max(max_slope_, fabs(y - surface.position(ku, kv - 1).y) /
+                                                (zs_[static_cast<size_t>(kv)] -
+                                                 zs_[static_cast<size_t>(kv - 1)]));
+        }
+      }
+    }
+  }
+
+  [[nodiscard]] Contact Check(const Bounce &bounce) const {
+    if (HitsBoard(bounce)) {
+      return Contact::kBoard;
+    }
+    if (HitsRim(bounce)) {
+      return Contact::kRim;
+    }
+    return Contact::kNone;
+  }
+
+ private:
+  // Spacing of the samples along the path near the rim.
+  static constexpr double kRimStep = 0.005;
+  // Smallest step when marching towards the board, so grazing paths still terminate.
+  static constexpr double kMinBoardStep = 0.002;
+  // Step while beside the board, where there's no gap to close.
+  static constexpr double kBesideBoardStep = 0.02;
+
+  static glm::dvec3 Position(const Bounce &bounce, const double t) {
+    const glm::dvec3 &p = bounce.bounce_point_;
+    const glm::dvec3 &v = bounce.outgoing_velocity_;
+    return {p.x + v.x * t, p.y + v.y * t, p.z + v.z * t + 0.5 * g_accel * t * t};
+  }
+
+  // The later time the ball's center is at height z, which it must reach on the way down.
+  static double TimeAtHeight(const Bounce &bounce, const double z) {
+    const double vz = bounce.outgoing_velocity_.z;
+    const double dz = bounce.bounce_point_.z - z;
+    return (-vz + sqrt(std::max(0.0, vz * vz - 2 * g_accel * dz))) / g_accel;
+  }
+
+  [[nodiscard]] bool HitsRim(const Bounce &bounce) const {
+    const glm::dvec3 rim_center = Hoop::RimCenter();
+    const double rim_radius = Hoop::kRimDiameter / 2;
+    const double reach = radius_ + Hoop::kRimTubeRadius;
+
+    // broadphase: while the ball is within reach of the rim plane, its horizontal path is a
+    // segment, which must get within reach of the rim circle
+    const double t_begin = bounce.bounce_point_.z >= rim_center.z - reach
+                               ? 0
+                               : TimeAtHeight(bounce, rim_center.z - reach);
+    const double t_end = TimeAtHeight(bounce, rim_center.z + reach);
+    const glm::dvec3 begin = Position(bounce, t_begin);
+    const double ax = begin.x - rim_center.x;
+    const double ay = begin.y - rim_center.y;
+    const double dx = bounce.outgoing_velocity_.x * (t_end - t_begin);
+    const double dy = bounce.outgoing_velocity_.y * (t_end - t_begin);
+    const double length2 = dx * dx + dy * dy;
+    const double s = length2 > 0 ? std::clamp(-(ax * dx + ay * dy) / length2, 0.0, 1.0) : 0.0;
+    const double closest = sqrt((ax + s * dx) * (ax + s * dx) + (ay + s * dy) * (ay + s * dy));
+    const double farthest = std::max(sqrt(ax * ax + ay * ay),
+                                     sqrt((ax + dx) * (ax + dx) + (ay + dy) * (ay + dy)));
+    if (closest > rim_radius + reach || farthest < rim_radius - reach) {
+      return false;  // passes wide, or clean through the middle
+    }
+
+    // sample the distance from the ball's center to the rim circle
+    const double max_speed = glm::length(bounce.outgoing_velocity_) + g_accel * t_end;
+    const int n =
+        std::max(2, static_cast<int>(std::ceil((t_end - t_begin) * max_speed / kRimStep)));
+    for (int k = 0; k <= n; k++) {
+      const double t = t_begin + (t_end - t_begin) * k / n;
+      const glm::dvec3 p = Position(bounce, t);
+      const double rho = sqrt((p.x - rim_center.x) * (p.x - rim_center.x) +
+                              (p.y - rim_center.y) * (p.y - rim_center.y));
+      const double dz = p.z - rim_center.z;
+      if ((rho - rim_radius) * (rho - rim_radius) + dz * dz < reach * reach) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  [[nodiscard]] bool HitsBoard(const Bounce &bounce) const {
+    const glm::dvec3 &v = bounce.outgoing_velocity_;
+    const double speed = glm::length(v);
+    // The board is above the rim, so the ball is past it once it's down at the rim.
+    const double t_end = bounce.land_time_;
+    // The gap between the ball and the board shrinks no faster than this.
+    const double max_vz = std::max(fabs(v.z), fabs(v.z + g_accel * t_end));
+    const double closing_speed = max_slope_ * (fabs(v.x) + max_vz) - v.y;
+    if (closing_speed <= 0) {
+      return false;  // moving away from the board faster than any part of it can come closer
+    }
+
+    // Leave the board first, without that counting as touching it.
+    double t = radius_ / speed;
+    while (t < t_end) {
+      const glm::dvec3 p = Position(bounce, t);
+      if (p.y > max_y_ && v.y >= 0) {
+        return false;  // in front of the whole board and moving away
+      }
+      if ((p.x < xs_.front() && v.x <= 0) || (p.x > xs_.back() && v.x >= 0)) {
+        return false;  // past the side of the board for good
+      }
+      const double board_y = BoardY(p.x, p.z);
+      if (std::isinf(board_y)) {
+        t += kBesideBoardStep / speed;
+        continue;
+      }
+      const double gap = p.y - board_y;
+      if (gap <= 0) {
+        return true;
+      }
+      t += std::max(gap / closing_speed, kMinBoardStep / speed);
+    }
+    return false;
+  }
+
+  // Height of the board at (x, z), or -infinity beside it.
+  [[nodiscard]] double BoardY(const double x, const double z) const {
+    if (x < xs_.front() || x > xs_.back() || z < zs_.front() || z > zs_.back()) {
+      return -std::numeric_limits<double>::infinity();
+    }
+    const auto ku = static_cast<int>(
+        std::min<ptrdiff_t>(std::upper_bound(xs_.begin(), xs_.end(), x) - xs_.begin(), NU - 1));
+    const auto kv = static_cast<int>(
+        std::min<ptrdiff_t>(std::upper_bound(zs_.begin(), zs_.end(), z) - zs_.begin(), NV - 1));
+    const double fu = (x - xs_[static_cast<size_t>(ku - 1)]) /
+                      (xs_[static_cast<size_t>(ku)] - xs_[static_cast<size_t>(ku - 1)]);
+    const double fv = (z - zs_[static_cast<size_t>(kv - 1)]) /
+                      (zs_[static_cast<size_t>(kv)] - zs_[static_cast<size_t>(kv - 1)]);
+    const double y0 = (1 - fu) * surface_.position(ku - 1, kv - 1).y +
+                      fu * surface_.position(ku, kv - 1).y;
+    const double y1 =
+        (1 - fu) * surface_.position(ku - 1, kv).y + fu * surface_.position(ku, kv).y;
+    return (1 - fv) * y0 + fv * y1;
+  }
+
+  const Surface<NU, NV> &surface_;
+  double radius_;
+  std::array<double, NU> xs_{};
+  std::array<double, NV> zs_{};
+  double max_y_;
+  // steepest |dy/dx| or |dy/dz| of the interpolated board
+  double max_slope_;
+};
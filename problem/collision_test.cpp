@@ -0,0 +1,109 @@
+#include <cmath>               // for sqrt
+#include <cstdio>              // for fprintf, stderr
+#include <cstdlib>             // for EXIT_SUCCESS
+#include <eigen3/Eigen/Dense>  // for Matrix
+#include <glm/glm.hpp>         // for dvec3, length
+
+#include "bb3d/assert.hpp"        // for ASSERT
+#include "bspline.hpp"            // for Surface
+#include "problem/backboard.hpp"  // for Backboard
+#include "problem/collision.hpp"  // for BallCollisions, BallParameters, Contact
+#include "problem/config.hpp"     // for NX, NY, NU_OBJ, NV_OBJ
+#include "problem/hoop.hpp"       // for Hoop
+#include "problem/problem.hpp"    // for Problem
+#include "problem/shot.hpp"       // for Bounce, g_accel
+#include "problem/shot_set.hpp"   // for ShotSet
+
+using BoardSurface = Surface<NU_OBJ, NV_OBJ>;
+using Collisions = BallCollisions<NU_OBJ, NV_OBJ>;
+
+// A flat board at y = 0, with the bottom row of control points pulled forward by shelf.
+static BoardSurface Board(const double shelf) {
+  Eigen::Matrix<double, NX, NY> dvs = Eigen::Matrix<double, NX, NY>::Zero();
+  // z is down, so the last row is the bottom of the board
+  dvs.col(NY - 1).setConstant(shelf);
+  return Backboard<NX, NY>::Interpolate<NU_OBJ, NV_OBJ>(Backboard<NX, NY>::ToControlPoints(dvs));
+}
+
+// The bounce off a flat board at bounce_point, going up at 1 m/s, that comes down through the rim
+// plane at (x, y).
+static Bounce BounceLandingAt(const glm::dvec3 &bounce_point, const double x, const double y) {
+  const double vz = -1;
+  const double pz0 = Hoop::kRimHeight + bounce_point.z;
+  const double t = (-vz + std::sqrt(vz * vz - 2 * pz0 * g_accel)) / g_accel;
+  const glm::dvec3 incoming((x - bounce_point.x) / t, -(y - bounce_point.y) / t, vz);
+  const Bounce bounce(bounce_point, incoming, {0, 1, 0});
+  ASSERT(glm::length(bounce.landing_point_ - glm::dvec3(x, y, -Hoop::kRimHeight)) < 1e-9);
+  return bounce;
+}
+
+static void TestRim() {
+  const BoardSurface board = Board(0);
+  const BallParameters ball;
+  const Collisions collisions(board, ball);
+  const glm::dvec3 bounce_point(0.1, 0, -3.5);
+  const glm::dvec3 rim_center = Hoop::RimCenter();
+  const double rim_radius = Hoop::kRimDiameter / 2;
+
+  // through the middle
+  ASSERT(collisions.Check(BounceLandingAt(bounce_point, rim_center.x, rim_center.y)) ==
+         Contact::kNone);
+  // right on the rim, at the front, back and side
+  ASSERT(collisions.Check(BounceLandingAt(bounce_point, 0, rim_center.y + rim_radius)) ==
+         Contact::kRim);
+  ASSERT(collisions.Check(BounceLandingAt(bounce_point, 0, rim_center.y - rim_radius)) ==
+         Contact::kRim);
+  ASSERT(collisions.Check(BounceLandingAt(bounce_point, rim_radius, rim_center.y)) ==
+         Contact::kRim);
+  // well clear of it, in front and to the side
+  ASSERT(collisions.Check(BounceLandingAt(bounce_point, 0, rim_center.y + rim_radius + 0.2)) ==
+         Contact::kNone);
+  ASSERT(collisions.Check(BounceLandingAt(bounce_point, rim_radius + 0.3, rim_center.y)) ==
+         Contact::kNone);
+
+  // A ball's width inside the front of the rim, only a big ball touches it.
+  const Bounce inside = BounceLandingAt(bounce_point, 0, rim_center.y + rim_radius - 0.1);
+  ASSERT(collisions.Check(inside) == Contact::kRim);
+  BallParameters small;
+  small.radius = 0.01;
+  ASSERT(Collisions(board, small).Check(inside) == Contact::kNone);
+}
+
+// A ball dropping off the upper board with no speed away from it falls past a flat board but
+// catches a bottom edge that sticks out.
+static void TestBoard() {
+  const BallParameters ball;
+  const BoardSurface flat = Board(0);
+  const BoardSurface shelf = Board(0.3);
+  // clear of the rim to the side, near the top
+  const int ku = NU_OBJ - 3;
+  ASSERT(flat.position(ku, 1).x > 0.5);
+
+  const Bounce flat_bounce(flat.position(ku, 1), {0, 0, -1}, {0, 1, 0});
+  ASSERT(Collisions(flat, ball).Check(flat_bounce) == Contact::kNone);
+  const Bounce shelf_bounce(shelf.position(ku, 1), {0, 0, -1}, {0, 1, 0});
+  ASSERT(Collisions(shelf, ball).Check(shelf_bounce) == Contact::kBoard);
+
+  // moving away from the board faster than the shelf sticks out
+  const Bounce away(shelf.position(ku, 1), {0, -2, -1}, {0, 1, 0});
+  ASSERT(Collisions(shelf, ball).Check(away) == Contact::kNone);
+}
+
+// Collisions only ever make a sample score worse.
+static void TestObjective() {
+  const ShotSet shot_set = ShotSet::Grid();
+  const auto control_points = Backboard<NX, NY>::Initialize();
+  const double point_mass =
+      Problem<NX, NY>::ObjectiveFunction<NU_OBJ, NV_OBJ>(control_points, shot_set);
+  const double finite_ball = Problem<NX, NY>::FiniteBallObjectiveFunction<NU_OBJ, NV_OBJ>(
+      control_points, shot_set, BallParameters());
+  ASSERT(finite_ball >= point_mass);
+}
+
+int main() {
+  TestRim();
+  TestBoard();
+  TestObjective();
+  fprintf(stderr, "collision tests passed\n");
+  return EXIT_SUCCESS;
+}
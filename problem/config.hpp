@@ -0,0 +1,60 @@
+#pragma once
+
+#include <eigen3/Eigen/Dense>  // for Matrix
+#include <vector>              // for vector
+
+#include "bb3d/assert.hpp"  // for ASSERT
+
+// Problem dimensions shared by the visualizer and the objective server.
+constexpr int NX = 6;
+constexpr int NY = 4;
+
+constexpr int NU_VIS = 20;
+constexpr int NV_VIS = 30;
+
+constexpr int NU_OBJ = 14;
+constexpr int NV_OBJ = 8;
+
+// Every design variable stays within these bounds.
+constexpr double kDvLowerBound = -10;
+constexpr double kDvUpperBound = 2;
+
+// Whether all NX * NY design variables at dvs are finite and within bounds. The objective ASSERTs
+// on designs it can't handle, so anything that comes from outside the optimizer is checked first.
+inline bool DvsValid(const double *dvs) {
+  for (int k = 0; k < NX * NY; k++) {
+    const double dv = dvs[k];  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    // false for NaN too
+    if (!(dv >= kDvLowerBound && dv <= kDvUpperBound)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Design variables are flattened row-major, i.e. ky varies fastest.
+inline Eigen::Matrix<double, NX, NY> Vec2Dvs(const double *vec) {
+  Eigen::Matrix<double, NX, NY> mat;
+  int k = 0;
+  for (int kx = 0; kx < NX; kx++) {
+    for (int ky = 0; ky < NY; ky++) {
+      mat(kx, ky) = vec[k];  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      k++;
+    }
+  }
+  return mat;
+}
+inline Eigen::Matrix<double, NX, NY> Vec2Dvs(const std::vector<double> &vec) {
+  ASSERT(NX * NY == vec.size());
+  return Vec2Dvs(vec.data());
+}
+inline std::vector<double> Dvs2Vec(const Eigen::Matrix<double, NX, NY> &mat) {
+  std::vector<double> vec;
+  vec.reserve(NX * NY);
+  for (int kx = 0; kx < NX; kx++) {
+    for (int ky = 0; ky < NY; ky++) {
+      vec.push_back(mat(kx, ky));
+    }
+  }
+  return vec;
+}
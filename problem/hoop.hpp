@@ -10,6 +10,7 @@ class Hoop {
   static constexpr double kRimHeight = 3.05;            // 10 feet
   static constexpr double kRimDiameter = 0.4572;        // 18"
   static constexpr double kRimBackboardOffset = 0.151;  // 6"
+  static constexpr double kRimTubeRadius = 0.008;       // 5/8" steel rod
   static constexpr double kRimCenterY = kRimBackboardOffset + kRimDiameter;
   static glm::dvec3 RimCenter() { return {0, kRimCenterY, -kRimHeight}; }
 
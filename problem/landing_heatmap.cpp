@@ -0,0 +1,105 @@
+#include "problem/landing_heatmap.hpp"
+
+#include <cmath>  // for floor, pow
+
+#include "bb3d/assert.hpp"  // for ASSERT
+
+LandingHeatmap::LandingHeatmap(const uint64_t designs_per_epoch)
+    : designs_per_epoch_(designs_per_epoch),
+      shards_(std::make_unique<Shard[]>(kNumShards)) {  // NOLINT(modernize-avoid-c-arrays)
+  ASSERT(designs_per_epoch > 0);
+  for (size_t k = 0; k < kNumShards; k++) {
+    for (Bins &bins : shards_[k].epochs) {
+      for (std::atomic<uint64_t> &bin : bins) {
+        bin.store(0, std::memory_order_relaxed);
+      }
+    }
+    for (std::atomic<uint64_t> &bin : shards_[k].all_time) {
+      bin.store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+bool LandingHeatmap::Cell(const glm::dvec3 &landing_point, int *kx, int *ky) {
+  const double fx = (landing_point.x - MinX()) / (MaxX() - MinX());
+  const double fy = (landing_point.y - MinY()) / (MaxY() - MinY());
+  if (!(fx >= 0 && fx < 1 && fy >= 0 && fy < 1)) {
+    return false;
+  }
+  *kx = static_cast<int>(floor(fx * kCells));
+  *ky = static_cast<int>(floor(fy * kCells));
+  return true;
+}
+
+size_t LandingHeatmap::ThisThreadShard() {
+  // Threads take shards round robin the first time they write.
+  static std::atomic<size_t> next_shard{0};
+  thread_local const size_t shard = next_shard++ % kNumShards;
+  return shard;
+}
+
+void LandingHeatmap::Add(const glm::dvec3 &landing_point) {
+  int kx = 0;
+  int ky = 0;
+  if (!Cell(landing_point, &kx, &ky)) {
+    return;
+  }
+  const auto cell = static_cast<size_t>(kx * kCells + ky);
+  // Acquire pairs with StartEpoch, so the new epoch's bins are cleared before they're counted in.
+  const uint64_t epoch = epoch_.load(std::memory_order_acquire);
+  Shard &shard = shards_[ThisThreadShard()];
+  shard.epochs[epoch % kNumEpochs][cell].fetch_add(1, std::memory_order_relaxed);
+  shard.all_time[cell].fetch_add(1, std::memory_order_relaxed);
+}
+
+void LandingHeatmap::EndDesign() {
+  const uint64_t designs = designs_.fetch_add(1) + 1;
+  if (designs % designs_per_epoch_ == 0) {
+    StartEpoch(designs / designs_per_epoch_);
+  }
+}
+
+void LandingHeatmap::StartEpoch(const uint64_t epoch) {
+  // The slot being reused held the oldest epoch, which nobody is still writing to.
+  for (size_t k = 0; k < kNumShards; k++) {
+    for (std::atomic<uint64_t> &bin : shards_[k].epochs[epoch % kNumEpochs]) {
+      bin.store(0, std::memory_order_relaxed);
+    }
+  }
+  // Epochs can end on different threads at once, so only ever move forward.
+  uint64_t current = epoch_.load(std::memory_order_relaxed);
+  while (current < epoch && !epoch_.compare_exchange_weak(current, epoch, std::memory_order_release,
+                                                          std::memory_order_relaxed)) {
+  }
+}
+
+void LandingHeatmap::Accumulate(const Bins &bins, const float weight, Grid *grid) {
+  for (int kx = 0; kx < kCells; kx++) {
+    for (int ky = 0; ky < kCells; ky++) {
+      const uint64_t count =
+          bins[static_cast<size_t>(kx * kCells + ky)].load(std::memory_order_relaxed);
+      (*grid)(kx, ky) += weight * static_cast<float>(count);
+    }
+  }
+}
+
+LandingHeatmap::Grid LandingHeatmap::Decayed(const double decay) const {
+  ASSERT(decay >= 0 && decay <= 1);
+  const uint64_t epoch = epoch_.load(std::memory_order_acquire);
+  Grid grid = Grid::Zero();
+  for (uint64_t age = 0; age < kNumEpochs && age <= epoch; age++) {
+    const auto weight = static_cast<float>(pow(decay, static_cast<double>(age)));
+    for (size_t k = 0; k < kNumShards; k++) {
+      Accumulate(shards_[k].epochs[(epoch - age) % kNumEpochs], weight, &grid);
+    }
+  }
+  return grid;
+}
+
+LandingHeatmap::Grid LandingHeatmap::AllTime() const {
+  Grid grid = Grid::Zero();
+  for (size_t k = 0; k < kNumShards; k++) {
+    Accumulate(shards_[k].all_time, 1, &grid);
+  }
+  return grid;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>               // for array
+#include <atomic>              // for atomic
+#include <cstddef>             // for size_t
+#include <cstdint>             // for uint64_t
+#include <eigen3/Eigen/Dense>  // for Matrix
+#include <glm/glm.hpp>         // for dvec3
+#include <memory>              // for unique_ptr
+
+#include "problem/hoop.hpp"  // for Hoop
+
+// Where shots land, accumulated over a whole optimization run in fixed memory.
+//
+// The grid has a fixed extent around the rim, so cells mean the same thing from one design to the
+// next, and landings outside it aren't binned. Writers never lock: each thread bumps relaxed atomic
+// counters in its own shard, and readers sum the shards. A read that races with writers may miss
+// their latest counts, which only matters for an instant.
+//
+// Besides the all-time counts, the most recent kNumEpochs epochs of designs_per_epoch designs each
+// are kept in a ring, for views that weigh recent designs more than old ones.
+class LandingHeatmap {
+ public:
+  static constexpr int kCells = 40;
+  // Half the side of the square covered by the grid, centered on the rim.
+  static constexpr double kHalfWidth = 1.5;
+  static constexpr int kNumEpochs = 32;
+
+  using Grid = Eigen::Matrix<float, kCells, kCells>;
+
+  explicit LandingHeatmap(uint64_t designs_per_epoch);
+
+  static double MinX() { return Hoop::RimCenter().x - kHalfWidth; }
+  static double MaxX() { return Hoop::RimCenter().x + kHalfWidth; }
+  static double MinY() { return Hoop::RimCenter().y - kHalfWidth; }
+  static double MaxY() { return Hoop::RimCenter().y + kHalfWidth; }
+
+  // The cell a landing point falls in. Returns false if it's outside the grid.
+  static bool Cell(const glm::dvec3 &landing_point, int *kx, int *ky);
+
+  void Add(const glm::dvec3 &landing_point);
+  // Call after adding all of a design's landings. Every designs_per_epoch designs start an epoch.
+  void EndDesign();
+
+  [[nodiscard]] uint64_t Designs() const { return designs_; }
+
+  // Landings per cell with the current epoch weighted 1, the one before decay, then decay^2 and so
+  // on back kNumEpochs epochs.
+  [[nodiscard]] Grid Decayed(double decay) const;
+  // Landings per cell since the start.
+  [[nodiscard]] Grid AllTime() const;
+
+ private:
+  static constexpr size_t kNumShards = 4;
+  using Bins = std::array<std::atomic<uint64_t>, kCells * kCells>;
+  struct alignas(64) Shard {
+    std::array<Bins, kNumEpochs> epochs;
+    Bins all_time;
+  };
+
+  static size_t ThisThreadShard();
+  void StartEpoch(uint64_t epoch);
+  static void Accumulate(const Bins &bins, float weight, Grid *grid);
+
+  uint64_t designs_per_epoch_;
+  std::unique_ptr<Shard[]> shards_;  // NOLINT(modernize-avoid-c-arrays)
+  std::atomic<uint64_t> designs_{0};
+  std::atomic<uint64_t> epoch_{0};
+};
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>           // for min
+#include <cmath>               // for fabs
+#include <eigen3/Eigen/Dense>  // for Matrix, Map, VectorXd, RowMajor
+#include <glm/glm.hpp>         // for dvec3
+#include <vector>              // for vector
+
+#include "bb3d/assert.hpp"        // for ASSERT
+#include "bspline.hpp"            // for Surface
+#include "problem/backboard.hpp"  // for Backboard
+
+struct ManufacturingLimits {
+  // Furthest the surface may stand off the flat backboard plane (y = 0), either way.
+  double max_depth = 0.4;
+  // Largest |dy/dx| and |dy/dz|.
+  double max_slope = 1.0;
+  // Largest principal curvature, i.e. 1 / the tightest bend radius the shop can make.
+  double max_curvature = 2.0;
+};
+
+// Fabrication limits as inequality constraints c(x) <= 0 on the design variables, checked at the
+// bounce points of an NU x NV grid, i.e. every grid point but the border where the clamped spline's
+// tangents vanish.
+//
+// Only y depends on the design variables and the spline is linear in its control points, while x
+// only varies with u and z only with v. So depth, slope and the second derivatives of the surface
+// as a height field y(x, z) are all linear in the design variables, and the constraints are exactly
+// c(x) = A x - limit. A is worked out once per grid from the surface of each design variable's
+// basis function, after which evaluating every constraint and its Jacobian is one small
+// matrix-vector product instead of another pass over the surface.
+//
+// The principal curvatures of y(x, z) are at most the eigenvalues of its Hessian, which are bounded
+// by |y_xx| + |y_xz| and |y_zz| + |y_xz| (Gershgorin), so those are what's constrained, one linear
+// constraint per sign combination.
+template <int NX, int NY>
+class ManufacturingConstraints {
+ public:
+  static constexpr int kNumDvs = NX * NY;
+  static constexpr int kConstraintsPerPoint = 14;
+
+  template <int NU, int NV>
+  static ManufacturingConstraints Build(const ManufacturingLimits &limits) {
+    static_assert(NU > 2 && NV > 2, "need interior grid points");
+    // Design variables only move control points in y, so x and z of the surface come from here.
+    const Surface<NU, NV> geometry = Backboard<NX, NY>::template Interpolate<NU, NV>(
+        Backboard<NX, NY>::ToControlPoints(Eigen::Matrix<double, NX, NY>::Zero()));
+    // The surface with design variable j set to 1 and every other control point coordinate 0.
+    std::vector<Surface<NU, NV>> basis;
+    basis.reserve(kNumDvs);
+    for (int j = 0; j < kNumDvs; j++) {
+      Eigen::Matrix<glm::dvec3, NX, NY> control_points;
+      for (int kx = 0; kx < NX; kx++) {
+        for (int ky = 0; ky < NY; ky++) {
+          control_points(kx, ky) = glm::dvec3(0, 0, 0);
+        }
+      }
+      // same ordering as Vec2Dvs
+      control_points(j / NY, j % NY).y = 1;
+      basis.push_back(Backboard<NX, NY>::template Interpolate<NU, NV>(control_points));
+    }
+
+    ManufacturingConstraints constraints;
+    constexpr int num_rows = (NU - 2) * (NV - 2) * kConstraintsPerPoint;
+    constraints.jacobian_.resize(num_rows, kNumDvs);
+    constraints.limit_.resize(num_rows);
+    int row = 0;
+    auto add = [&constraints, &row](const Eigen::Matrix<double, 1, kNumDvs> &gradient,
+                                    const double limit) {
+      constraints.jacobian_.row(row) = gradient;
+      constraints.limit_(row) = limit;
+      row++;
+    };
+
+    for (int ku = 1; ku < NU - 1; ku++) {
+      for (int kv = 1; kv < NV - 1; kv++) {
+        const double x_u = geometry.tangent_u(ku, kv).x;
+        const double x_uu = geometry.position_uu(ku, kv).x;
+        const double z_v = geometry.tangent_v(ku, kv).z;
+        const double z_vv = geometry.position_vv(ku, kv).z;
+        ASSERT(fabs(x_u) > 0);
+        ASSERT(fabs(z_v) > 0);
+
+        Eigen::Matrix<double, 1, kNumDvs> y;
+        Eigen::Matrix<double, 1, kNumDvs> y_x;
+        Eigen::Matrix<double, 1, kNumDvs> y_z;
+        Eigen::Matrix<double, 1, kNumDvs> y_xx;
+        Eigen::Matrix<double, 1, kNumDvs> y_zz;
+        Eigen::Matrix<double, 1, kNumDvs> y_xz;
+        for (int j = 0; j < kNumDvs; j++) {
+          const Surface<NU, NV> &b = basis[static_cast<size_t>(j)];
+          const double y_u = b.tangent_u(ku, kv).y;
+          const double y_v = b.tangent_v(ku, kv).y;
+          y(j) = b.position(ku, kv).y;
+          // chain rule with x = x(u), z = z(v)
+          y_x(j) = y_u / x_u;
+          y_z(j) = y_v / z_v;
+          y_xx(j) = (b.position_uu(ku, kv).y * x_u - y_u * x_uu) / (x_u * x_u * x_u);
+          y_zz(j) = (b.position_vv(ku, kv).y * z_v - y_v * z_vv) / (z_v * z_v * z_v);
+          y_xz(j) = b.position_uv(ku, kv).y / (x_u * z_v);
+        }
+
+        for (const double sign : {1.0, -1.0}) {
+          add(sign * y, limits.max_depth);
+          add(sign * y_x, limits.max_slope);
+          add(sign * y_z, limits.max_slope);
+          for (const double twist_sign : {1.0, -1.0}) {
+            add(sign * y_xx + twist_sign * y_xz, limits.max_curvature);
+            add(sign * y_zz + twist_sign * y_xz, limits.max_curvature);
+          }
+        }
+      }
+    }
+    ASSERT(row == constraints.jacobian_.rows());
+    return constraints;
+  }
+
+  [[nodiscard]] unsigned Size() const { return static_cast<unsigned>(limit_.size()); }
+
+  // c(x) into result, and if gradient isn't null the Jacobian into it, row major as nlopt wants.
+  void Evaluate(const double *x, double *result, double *gradient) const {
+    const Eigen::Map<const Eigen::Matrix<double, kNumDvs, 1>> dvs(x);
+    Eigen::Map<Eigen::VectorXd>(result, limit_.size()) = jacobian_ * dvs - limit_;
+    if (gradient != nullptr) {
+      Eigen::Map<Jacobian>(gradient, jacobian_.rows(), kNumDvs) = jacobian_;
+    }
+  }
+
+  // The largest c_i(x): positive when x can't be built.
+  [[nodiscard]] double MaxViolation(const std::vector<double> &x) const {
+    ASSERT(x.size() == kNumDvs);
+    Eigen::VectorXd result(limit_.size());
+    Evaluate(x.data(), result.data(), nullptr);
+    return result.maxCoeff();
+  }
+
+  // Shrink x towards the flat board, which is always buildable, just far enough that it satisfies
+  // every constraint. Returns the factor x was scaled by, 1 if it was buildable already. Because
+  // the constraints are c(x) = A x - limit with every limit positive, scaling x by s scales A x
+  // by s, so this is exact.
+  double ScaleIntoLimits(std::vector<double> &x) const {
+    ASSERT(x.size() == kNumDvs);
+    const Eigen::VectorXd a_x = jacobian_ * Eigen::Map<const Eigen::Matrix<double, kNumDvs, 1>>(
+                                                 x.data());
+    double scale = 1;
+    for (Eigen::Index k = 0; k < a_x.size(); k++) {
+      ASSERT(limit_(k) > 0);
+      if (a_x(k) > limit_(k)) {
+        scale = std::min(scale, limit_(k) / a_x(k));
+      }
+    }
+    for (double &dv : x) {
+      dv *= scale;
+    }
+    return scale;
+  }
+
+  // for nlopt::opt::add_inequality_mconstraint, with data pointing at the constraints
+  static void NloptConstraint(const unsigned m, double *result, const unsigned n, const double *x,
+                              double *gradient, void *data) {
+    const auto *constraints = static_cast<const ManufacturingConstraints *>(data);
+    ASSERT(m == constraints->Size());
+    ASSERT(n == kNumDvs);
+    constraints->Evaluate(x, result, gradient);
+  }
+
+ private:
+  using Jacobian = Eigen::Matrix<double, Eigen::Dynamic, kNumDvs, Eigen::RowMajor>;
+
+  ManufacturingConstraints() = default;
+
+  Jacobian jacobian_;
+  Eigen::VectorXd limit_;
+};
@@ -0,0 +1,175 @@
+#include <algorithm>           // for max, sort
+#include <cmath>               // for fabs
+#include <cstdio>              // for fprintf, stderr
+#include <cstdlib>             // for EXIT_SUCCESS
+#include <eigen3/Eigen/Dense>  // for Matrix, VectorXd
+#include <glm/glm.hpp>         // for dvec3
+#include <random>              // for mt19937_64, uniform_real_distribution
+#include <vector>              // for vector
+
+#include "bb3d/assert.hpp"            // for ASSERT
+#include "bspline.hpp"                // for CubicBSplinePoint, PadSurface
+#include "problem/backboard.hpp"      // for Backboard
+#include "problem/config.hpp"         // for NX, NY, NU_OBJ, NV_OBJ, Vec2Dvs
+#include "problem/manufacturing.hpp"  // for ManufacturingConstraints, ManufacturingLimits
+
+using Constraints = ManufacturingConstraints<NX, NY>;
+constexpr int kNumDvs = Constraints::kNumDvs;
+
+static std::vector<double> RandomDesign(const double size) {
+  std::mt19937_64 rng(0);
+  std::uniform_real_distribution<double> dv(-size, size);
+  std::vector<double> x(kNumDvs);
+  for (double &value : x) {
+    value = dv(rng);
+  }
+  return x;
+}
+
+static Eigen::VectorXd Evaluate(const Constraints &constraints, const std::vector<double> &x) {
+  Eigen::VectorXd c(constraints.Size());
+  constraints.Evaluate(x.data(), c.data(), nullptr);
+  return c;
+}
+
+// The Jacobian nlopt gets, against central differences of the constraints.
+static void TestJacobian() {
+  Constraints constraints = Constraints::Build<NU_OBJ, NV_OBJ>(ManufacturingLimits());
+  const unsigned m = constraints.Size();
+  ASSERT(m == (NU_OBJ - 2) * (NV_OBJ - 2) * Constraints::kConstraintsPerPoint);
+  std::vector<double> x = RandomDesign(0.3);
+  std::vector<double> c(m);
+  std::vector<double> jacobian(m * kNumDvs);
+  Constraints::NloptConstraint(m, c.data(), kNumDvs, x.data(), jacobian.data(), &constraints);
+
+  const double h = 1e-6;
+  double max_error = 0;
+  for (int j = 0; j < kNumDvs; j++) {
+    const double x_j = x[static_cast<size_t>(j)];
+    x[static_cast<size_t>(j)] = x_j + h;
+    const Eigen::VectorXd c_plus = Evaluate(constraints, x);
+    x[static_cast<size_t>(j)] = x_j - h;
+    const Eigen::VectorXd c_minus = Evaluate(constraints, x);
+    x[static_cast<size_t>(j)] = x_j;
+    for (unsigned i = 0; i < m; i++) {
+      // row major
+      const double analytic = jacobian[i * kNumDvs + static_cast<unsigned>(j)];
+      const double numeric = (c_plus(i) - c_minus(i)) / (2 * h);
+      max_error = std::max(max_error, std::fabs(analytic - numeric) / (1 + std::fabs(analytic)));
+    }
+  }
+  fprintf(stderr, "constraint jacobian: largest relative error %.2e\n", max_error);
+  ASSERT(max_error < 1e-6);
+}
+
+// Depth, slopes and second derivatives of the board as a height field y(x, z), by central
+// differences on the spline itself, so nothing is shared with how Build works them out.
+struct HeightField {
+  double y, y_x, y_z, y_xx, y_zz, y_xz;
+};
+
+template <typename ControlPoints>
+static glm::dvec3 At(const ControlPoints &ps, const double sx, const double sy) {
+  return CubicBSplinePoint(ps, sx, sy).position;
+}
+
+template <typename ControlPoints>
+static double SlopeX(const ControlPoints &ps, const double sx, const double sy) {
+  const double h = 1e-6;
+  const glm::dvec3 plus = At(ps, sx + h, sy);
+  const glm::dvec3 minus = At(ps, sx - h, sy);
+  return (plus.y - minus.y) / (plus.x - minus.x);
+}
+
+template <typename ControlPoints>
+static double SlopeZ(const ControlPoints &ps, const double sx, const double sy) {
+  const double h = 1e-6;
+  const glm::dvec3 plus = At(ps, sx, sy + h);
+  const glm::dvec3 minus = At(ps, sx, sy - h);
+  return (plus.y - minus.y) / (plus.z - minus.z);
+}
+
+template <typename ControlPoints>
+static HeightField Differentiate(const ControlPoints &ps, const double sx, const double sy) {
+  // The third derivatives jump at knots, so the second differences are only first order there.
+  const double h = 1e-4;
+  const double dx = At(ps, sx + h, sy).x - At(ps, sx - h, sy).x;
+  const double dz = At(ps, sx, sy + h).z - At(ps, sx, sy - h).z;
+  HeightField f{};
+  f.y = At(ps, sx, sy).y;
+  f.y_x = SlopeX(ps, sx, sy);
+  f.y_z = SlopeZ(ps, sx, sy);
+  f.y_xx = (SlopeX(ps, sx + h, sy) - SlopeX(ps, sx - h, sy)) / dx;
+  f.y_zz = (SlopeZ(ps, sx, sy + h) - SlopeZ(ps, sx, sy - h)) / dz;
+  f.y_xz = (SlopeX(ps, sx, sy + h) - SlopeX(ps, sx, sy - h)) / dz;
+  return f;
+}
+
+// Every constraint at every bounce point against the height field's derivatives.
+static void TestAgainstSurface() {
+  const ManufacturingLimits limits;
+  const Constraints constraints = Constraints::Build<NU_OBJ, NV_OBJ>(limits);
+  const std::vector<double> x = RandomDesign(0.3);
+  const Eigen::VectorXd c = Evaluate(constraints, x);
+  const auto ps = PadSurface<NX, NY>(Backboard<NX, NY>::ToControlPoints(Vec2Dvs(x)));
+
+  double max_error = 0;
+  int row = 0;
+  for (int ku = 1; ku < NU_OBJ - 1; ku++) {
+    for (int kv = 1; kv < NV_OBJ - 1; kv++) {
+      const HeightField f = Differentiate(ps, ku / (NU_OBJ - 1.0), kv / (NV_OBJ - 1.0));
+      // both signs of depth and slope, and the Gershgorin bounds on curvature
+      std::vector<double> expected;
+      for (const double sign : {1.0, -1.0}) {
+        expected.push_back(sign * f.y - limits.max_depth);
+        expected.push_back(sign * f.y_x - limits.max_slope);
+        expected.push_back(sign * f.y_z - limits.max_slope);
+        for (const double twist_sign : {1.0, -1.0}) {
+          expected.push_back(sign * f.y_xx + twist_sign * f.y_xz - limits.max_curvature);
+          expected.push_back(sign * f.y_zz + twist_sign * f.y_xz - limits.max_curvature);
+        }
+      }
+      ASSERT(expected.size() == Constraints::kConstraintsPerPoint);
+      std::vector<double> actual(expected.size());
+      for (double &value : actual) {
+        value = c(row);
+        row++;
+      }
+      // compare the sets, whatever order Build adds them in
+      std::sort(expected.begin(), expected.end());
+      std::sort(actual.begin(), actual.end());
+      for (size_t k = 0; k < expected.size(); k++) {
+        max_error = std::max(max_error, std::fabs(actual.at(k) - expected.at(k)) /
+                                            (1 + std::fabs(expected.at(k))));
+      }
+    }
+  }
+  fprintf(stderr, "constraints against the surface: largest relative error %.2e\n", max_error);
+  ASSERT(max_error < 1e-4);
+}
+
+static void TestScaleIntoLimits() {
+  const Constraints constraints = Constraints::Build<NU_OBJ, NV_OBJ>(ManufacturingLimits());
+  // the flat board is buildable
+  ASSERT(constraints.MaxViolation(std::vector<double>(kNumDvs, 0)) < 0);
+
+  // a wild design is shrunk until exactly on its tightest limit
+  std::vector<double> x = RandomDesign(2);
+  ASSERT(constraints.MaxViolation(x) > 0);
+  const double scale = constraints.ScaleIntoLimits(x);
+  ASSERT(scale > 0 && scale < 1);
+  ASSERT(std::fabs(constraints.MaxViolation(x)) < 1e-12);
+
+  // and left alone once it's buildable
+  const std::vector<double> buildable = x;
+  ASSERT(constraints.ScaleIntoLimits(x) == 1);
+  ASSERT(x == buildable);
+}
+
+int main() {
+  TestJacobian();
+  TestAgainstSurface();
+  TestScaleIntoLimits();
+  fprintf(stderr, "manufacturing tests passed\n");
+  return EXIT_SUCCESS;
+}
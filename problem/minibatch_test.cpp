@@ -0,0 +1,61 @@
+#include <cmath>        // for sqrt, fabs
+#include <cstdint>      // for uint64_t
+#include <cstdio>       // for fprintf, stderr
+#include <cstdlib>      // for EXIT_SUCCESS
+#include <glm/glm.hpp>  // for dvec3
+#include <random>       // for mt19937_64, uniform_real_distribution
+#include <vector>       // for vector
+
+#include "bb3d/assert.hpp"        // for ASSERT
+#include "problem/backboard.hpp"  // for Backboard
+#include "problem/config.hpp"     // for NX, NY, NU_OBJ, NV_OBJ
+#include "problem/problem.hpp"    // for Problem, Problem<>::Sampling
+#include "problem/shot_set.hpp"   // for ShotSet
+
+using Sampling = Problem<NX, NY>::Sampling;
+
+constexpr int kNumSeeds = 40000;
+
+// The mean of the minibatch estimate over kNumSeeds seeds has to be within a few standard errors
+// of the full objective.
+static void CheckUnbiased(const ShotSet &shot_set, const int batch_size, const Sampling sampling) {
+  const auto control_points = Backboard<NX, NY>::Initialize();
+  const double exact = Problem<NX, NY>::ObjectiveFunction<NU_OBJ, NV_OBJ>(control_points, shot_set);
+  double sum = 0;
+  double sum_squares = 0;
+  for (uint64_t seed = 0; seed < kNumSeeds; seed++) {
+    std::mt19937_64 rng(seed);
+    const double estimate = Problem<NX, NY>::MinibatchObjectiveFunction<NU_OBJ, NV_OBJ>(
+        control_points, shot_set, batch_size, sampling, rng);
+    sum += estimate;
+    sum_squares += estimate * estimate;
+  }
+  const double mean = sum / kNumSeeds;
+  const double standard_error = std::sqrt((sum_squares / kNumSeeds - mean * mean) / kNumSeeds);
+  fprintf(stderr, "%zu shots, batch %d, %s: mean off by %.2f standard errors (%.2e relative)\n",
+          shot_set.Size(), batch_size, sampling == Sampling::kUniform ? "uniform" : "stratified",
+          (mean - exact) / standard_error, mean / exact - 1);
+  ASSERT(std::fabs(mean - exact) < 4 * standard_error);
+}
+
+int main() {
+  std::mt19937_64 rng(0);
+  std::uniform_real_distribution<double> x(-7, 7);
+  std::uniform_real_distribution<double> y(0.5, 12);
+  std::uniform_real_distribution<double> z(-2.8, -1.5);
+  std::vector<glm::dvec3> points;
+  for (int k = 0; k < 200; k++) {
+    points.emplace_back(x(rng), y(rng), z(rng));
+  }
+  const ShotSet scattered = ShotSet::FromPoints(points);
+  const ShotSet grid = ShotSet::Grid();
+
+  // more shot points than the batch: one sample per stratum
+  CheckUnbiased(scattered, 60, Sampling::kStratified);
+  CheckUnbiased(grid, 7, Sampling::kStratified);
+  // fewer: every shot point sampled, some once more than others
+  CheckUnbiased(grid, 50, Sampling::kStratified);
+  CheckUnbiased(scattered, 60, Sampling::kUniform);
+  fprintf(stderr, "minibatch tests passed\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,228 @@
+#include "problem/objective_cache.hpp"
+
+#include <cinttypes>  // for PRIu64
+#include <cmath>      // for llround
+#include <cstdio>     // for fprintf, stderr, fopen, fclose, fread, fwrite, remove, rename, FILE
+#include <cstring>    // for memcpy, memcmp
+
+#include "bb3d/assert.hpp"  // for ASSERT
+
+// File layout, all little-endian 64 bit words:
+//   magic, quantum (as double bits), number of entries,
+//   then per entry: key length, key words..., objective (as double bits), gradient length,
+//   gradient values (as double bits)...
+static constexpr char kMagic[8] = {'B', 'B', 'O', 'B', 'J', 'C', '0', '1'};
+static constexpr uint64_t kMaxVectorSize = 1U << 20U;
+
+static uint64_t DoubleBits(const double x) {
+  uint64_t bits{};
+  memcpy(&bits, &x, sizeof(bits));
+  return bits;
+}
+
+static double BitsDouble(const uint64_t bits) {
+  double x{};
+  memcpy(&x, &bits, sizeof(x));
+  return x;
+}
+
+ObjectiveCache::ObjectiveCache(const size_t capacity, const double quantum)
+    : shard_capacity_((capacity + kNumShards - 1) / kNumShards), quantum_(quantum) {
+  ASSERT(capacity > 0);
+  ASSERT(quantum >= 0);
+}
+
+size_t ObjectiveCache::KeyHash::operator()(const Key &key) const {
+  // FNV-1a over the key words
+  uint64_t hash = 14695981039346656037ULL;
+  for (const uint64_t word : key) {
+    hash ^= word;
+    hash *= 1099511628211ULL;
+  }
+  return static_cast<size_t>(hash);
+}
+
+ObjectiveCache::Key ObjectiveCache::MakeKey(const uint64_t tag,
+                                            const std::vector<double> &x) const {
+  Key key;
+  key.reserve(x.size() + 1);
+  key.push_back(tag);
+  for (const double xi : x) {
+    if (quantum_ > 0) {
+      key.push_back(static_cast<uint64_t>(std::llround(xi / quantum_)));
+    } else {
+      // +0.0 and -0.0 are the same design
+      key.push_back(DoubleBits(xi == 0 ? 0.0 : xi));
+    }
+  }
+  return key;
+}
+
+ObjectiveCache::Shard &ObjectiveCache::ShardFor(const Key &key) {
+  // Use the high bits so that shard selection is independent of bucket selection.
+  const size_t hash = KeyHash()(key);
+  return shards_.at((hash >> 32U) % kNumShards);
+}
+
+std::optional<ObjectiveCache::Entry> ObjectiveCache::Lookup(const uint64_t tag,
+                                                            const std::vector<double> &x) {
+  const Key key = MakeKey(tag, x);
+  Shard &shard = ShardFor(key);
+  const std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.index.find(key);
+  if (it == shard.index.end()) {
+    misses_++;
+    return std::nullopt;
+  }
+  hits_++;
+  shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+  return it->second->second;
+}
+
+void ObjectiveCache::Insert(const uint64_t tag, const std::vector<double> &x, const Entry &entry) {
+  InsertKey(MakeKey(tag, x), entry);
+}
+
+void ObjectiveCache::InsertKey(Key key, const Entry &entry) {
+  Shard &shard = ShardFor(key);
+  const std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.index.find(key);
+  if (it != shard.index.end()) {
+    it->second->second = entry;
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    return;
+  }
+  if (shard.lru.size() >= shard_capacity_) {
+    shard.index.erase(shard.lru.back().first);
+    shard.lru.pop_back();
+  }
+  shard.lru.emplace_front(std::move(key), entry);
+  shard.index.emplace(shard.lru.front().first, shard.lru.begin());
+}
+
+double ObjectiveCache::HitRate() const {
+  const uint64_t hits = hits_;
+  const uint64_t total = hits + misses_;
+  if (total == 0) {
+    return 0;
+  }
+  return static_cast<double>(hits) / static_cast<double>(total);
+}
+
+size_t ObjectiveCache::Size() {
+  size_t size = 0;
+  for (Shard &shard : shards_) {
+    const std::lock_guard<std::mutex> lock(shard.mutex);
+    size += shard.lru.size();
+  }
+  return size;
+}
+
+static bool ReadWord(FILE *file, uint64_t *word) {
+  return fread(word, sizeof(*word), 1, file) == 1;
+}
+
+static bool WriteWord(FILE *file, const uint64_t word) {
+  return fwrite(&word, sizeof(word), 1, file) == 1;
+}
+
+bool ObjectiveCache::Load(const std::string &path) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    fprintf(stderr, "objective cache: no cache at %s, starting empty\n", path.c_str());
+    return false;
+  }
+
+  bool ok = true;
+  char magic[sizeof(kMagic)];
+  uint64_t quantum_bits{};
+  uint64_t num_entries{};
+  if (fread(magic, sizeof(magic), 1, file) != 1 || memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+      !ReadWord(file, &quantum_bits) || !ReadWord(file, &num_entries)) {
+    fprintf(stderr, "objective cache: %s is not an objective cache\n", path.c_str());
+    ok = false;
+  } else if (BitsDouble(quantum_bits) != quantum_) {
+    fprintf(stderr, "objective cache: %s was written with quantum %g, not %g\n", path.c_str(),
+            BitsDouble(quantum_bits), quantum_);
+    ok = false;
+  }
+
+  for (uint64_t k = 0; ok && k < num_entries; k++) {
+    uint64_t key_size{};
+    uint64_t objective_bits{};
+    uint64_t gradient_size{};
+    // Sizes come from disk, don't let a corrupt file make us allocate the world.
+    ok = ReadWord(file, &key_size) && key_size <= kMaxVectorSize;
+    Key key(ok ? key_size : 0);
+    for (uint64_t &word : key) {
+      ok = ok && ReadWord(file, &word);
+    }
+    ok = ok && ReadWord(file, &objective_bits) && ReadWord(file, &gradient_size) &&
+         gradient_size <= kMaxVectorSize;
+    Entry entry{BitsDouble(objective_bits), std::vector<double>(ok ? gradient_size : 0)};
+    for (double &g : entry.gradient) {
+      uint64_t g_bits{};
+      ok = ok && ReadWord(file, &g_bits);
+      g = BitsDouble(g_bits);
+    }
+    if (!ok) {
+      fprintf(stderr, "objective cache: %s is corrupt after %" PRIu64 " entries\n", path.c_str(),
+              k);
+    } else {
+      InsertKey(std::move(key), entry);
+    }
+  }
+  fclose(file);
+  return ok;
+}
+
+bool ObjectiveCache::Save(const std::string &path) {
+  // Write a temporary file and rename it over path, so a failed or interrupted save never leaves a
+  // truncated cache behind.
+  const std::string tmp_path = path + ".tmp";
+  FILE *file = fopen(tmp_path.c_str(), "wb");
+  if (file == nullptr) {
+    fprintf(stderr, "objective cache: can't open %s for writing\n", tmp_path.c_str());
+    return false;
+  }
+
+  // Hold every shard so the entry count in the header matches what follows.
+  std::vector<std::unique_lock<std::mutex> > locks;
+  size_t num_entries = 0;
+  for (Shard &shard : shards_) {
+    locks.emplace_back(shard.mutex);
+    num_entries += shard.lru.size();
+  }
+
+  bool ok = fwrite(kMagic, sizeof(kMagic), 1, file) == 1 && WriteWord(file, DoubleBits(quantum_)) &&
+            WriteWord(file, num_entries);
+  for (const Shard &shard : shards_) {
+    // Least recently used first, so that reloading preserves recency order.
+    for (auto it = shard.lru.rbegin(); ok && it != shard.lru.rend(); it++) {
+      const Key &key = it->first;
+      const Entry &entry = it->second;
+      ok = WriteWord(file, key.size());
+      for (const uint64_t word : key) {
+        ok = ok && WriteWord(file, word);
+      }
+      ok = ok && WriteWord(file, DoubleBits(entry.objective)) &&
+           WriteWord(file, entry.gradient.size());
+      for (const double g : entry.gradient) {
+        ok = ok && WriteWord(file, DoubleBits(g));
+      }
+    }
+  }
+  // Buffered writes only fail for sure when the buffer is flushed.
+  ok = fclose(file) == 0 && ok;
+  if (!ok) {
+    fprintf(stderr, "objective cache: failed writing %s\n", tmp_path.c_str());
+    remove(tmp_path.c_str());
+    return false;
+  }
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    fprintf(stderr, "objective cache: can't rename %s to %s\n", tmp_path.c_str(), path.c_str());
+    remove(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>          // for array
+#include <atomic>         // for atomic
+#include <cstddef>        // for size_t
+#include <cstdint>        // for uint64_t
+#include <list>           // for list
+#include <mutex>          // for mutex
+#include <optional>       // for optional
+#include <string>         // for string
+#include <unordered_map>  // for unordered_map
+#include <utility>        // for pair
+#include <vector>         // for vector
+
+// Bounded, thread-safe memo of objective evaluations keyed on design vectors.
+//
+// Keys are either the exact bit patterns of the design variables (quantum == 0) or the design
+// variables rounded to a multiple of quantum. A caller-chosen tag is folded into every key so that
+// evaluations of different problem configurations (e.g. bounce grid resolutions) never collide.
+// Each shard is an independent LRU list behind its own mutex.
+class ObjectiveCache {
+ public:
+  struct Entry {
+    double objective;
+    std::vector<double> gradient;  // empty if the objective was evaluated without one
+  };
+
+  ObjectiveCache(size_t capacity, double quantum);
+
+  std::optional<Entry> Lookup(uint64_t tag, const std::vector<double> &x);
+  void Insert(uint64_t tag, const std::vector<double> &x, const Entry &entry);
+
+  [[nodiscard]] uint64_t Hits() const { return hits_; }
+  [[nodiscard]] uint64_t Misses() const { return misses_; }
+  [[nodiscard]] double HitRate() const;
+  [[nodiscard]] size_t Size();
+
+  // Binary persistence. Returns false (after printing why) if the file can't be used.
+  bool Load(const std::string &path);
+  bool Save(const std::string &path);
+
+ private:
+  using Key = std::vector<uint64_t>;
+  struct KeyHash {
+    size_t operator()(const Key &key) const;
+  };
+  using LruList = std::list<std::pair<Key, Entry> >;
+
+  static constexpr size_t kNumShards = 16;
+  struct Shard {
+    std::mutex mutex;
+    LruList lru;  // most recently used at the front
+    std::unordered_map<Key, LruList::iterator, KeyHash> index;
+  };
+
+  [[nodiscard]] Key MakeKey(uint64_t tag, const std::vector<double> &x) const;
+  Shard &ShardFor(const Key &key);
+  void InsertKey(Key key, const Entry &entry);
+
+  size_t shard_capacity_;
+  double quantum_;
+  std::array<Shard, kNumShards> shards_;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+};
@@ -0,0 +1,117 @@
+#include <cstdio>      // for fprintf, stderr
+#include <cstdlib>     // for getenv, EXIT_SUCCESS
+#include <filesystem>  // for create_directories, remove_all, file_size, resize_file, copy_file
+#include <optional>    // for optional
+#include <string>      // for string
+#include <vector>      // for vector
+
+#include "bb3d/assert.hpp"              // for ASSERT
+#include "problem/objective_cache.hpp"  // for ObjectiveCache, ObjectiveCache::Entry
+
+static std::string TestDir() {
+  // bazel test gives every test its own scratch directory
+  const char *tmpdir = std::getenv("TEST_TMPDIR");
+  const std::string dir = std::string(tmpdir != nullptr ? tmpdir : "/tmp") + "/objective_cache";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  return dir;
+}
+
+static bool SameEntry(const std::optional<ObjectiveCache::Entry> &entry, const double objective,
+                      const std::vector<double> &gradient) {
+  return entry && entry->objective == objective && entry->gradient == gradient;
+}
+
+static void TestLookup() {
+  ObjectiveCache cache(64, 0);
+  cache.Insert(1, {0.5, -2.0}, {3.0, {}});
+  ASSERT(SameEntry(cache.Lookup(1, {0.5, -2.0}), 3.0, {}));
+  // other tags are other problems
+  ASSERT(!cache.Lookup(2, {0.5, -2.0}));
+  // exact keys only
+  ASSERT(!cache.Lookup(1, {0.5, -2.0 + 1e-15}));
+  // +0.0 and -0.0 are the same design
+  cache.Insert(1, {0.0}, {4.0, {1.0}});
+  ASSERT(SameEntry(cache.Lookup(1, {-0.0}), 4.0, {1.0}));
+  ASSERT(cache.Hits() == 2);
+  ASSERT(cache.Misses() == 2);
+
+  // quantized keys match nearby designs
+  ObjectiveCache quantized(64, 1e-3);
+  quantized.Insert(1, {0.5}, {5.0, {}});
+  ASSERT(SameEntry(quantized.Lookup(1, {0.5 + 1e-4}), 5.0, {}));
+  ASSERT(!quantized.Lookup(1, {0.5 + 1e-2}));
+
+  // bounded
+  ObjectiveCache small(32, 0);
+  for (int k = 0; k < 1000; k++) {
+    small.Insert(1, {static_cast<double>(k)}, {0.0, {}});
+  }
+  ASSERT(small.Size() <= 32);
+  // the most recent insert always survives
+  ASSERT(small.Lookup(1, {999.0}));
+}
+
+static void TestRoundTrip(const std::string &dir) {
+  const std::string path = dir + "/cache.bin";
+  ObjectiveCache cache(1024, 0);
+  for (int k = 0; k < 100; k++) {
+    const double x = 0.01 * k - 0.3;
+    cache.Insert(7, {x, -x}, {x * x, {}});
+    cache.Insert(8, {x, -x}, {-x, {2 * x, 1e-300, -0.0}});
+  }
+  ASSERT(cache.Save(path));
+  ASSERT(!std::filesystem::exists(path + ".tmp"));
+
+  ObjectiveCache loaded(1024, 0);
+  ASSERT(loaded.Load(path));
+  ASSERT(loaded.Size() == cache.Size());
+  for (int k = 0; k < 100; k++) {
+    const double x = 0.01 * k - 0.3;
+    ASSERT(SameEntry(loaded.Lookup(7, {x, -x}), x * x, {}));
+    ASSERT(SameEntry(loaded.Lookup(8, {x, -x}), -x, {2 * x, 1e-300, -0.0}));
+  }
+
+  // a cache written with another quantum doesn't match the same keys
+  ObjectiveCache other_quantum(1024, 1e-6);
+  ASSERT(!other_quantum.Load(path));
+  ASSERT(other_quantum.Size() == 0);
+
+  // truncated files load what's intact and report the rest
+  const std::string truncated = dir + "/truncated.bin";
+  std::filesystem::copy_file(path, truncated);
+  std::filesystem::resize_file(truncated, std::filesystem::file_size(path) / 2);
+  ObjectiveCache partial(1024, 0);
+  ASSERT(!partial.Load(truncated));
+  ASSERT(partial.Size() < cache.Size());
+
+  ObjectiveCache missing(1024, 0);
+  ASSERT(!missing.Load(dir + "/missing.bin"));
+}
+
+static void TestFailedSave(const std::string &dir) {
+  const std::string path = dir + "/kept.bin";
+  ObjectiveCache cache(64, 0);
+  cache.Insert(1, {1.0}, {2.0, {}});
+  ASSERT(cache.Save(path));
+
+  // A save that can't write its temporary file fails and leaves the old cache alone.
+  std::filesystem::create_directories(path + ".tmp");
+  ObjectiveCache newer(64, 0);
+  newer.Insert(1, {1.0}, {3.0, {}});
+  ASSERT(!newer.Save(path));
+  ObjectiveCache loaded(64, 0);
+  ASSERT(loaded.Load(path));
+  ASSERT(SameEntry(loaded.Lookup(1, {1.0}), 2.0, {}));
+
+  ASSERT(!cache.Save(dir + "/no/such/dir/cache.bin"));
+}
+
+int main() {
+  const std::string dir = TestDir();
+  TestLookup();
+  TestRoundTrip(dir);
+  TestFailedSave(dir);
+  fprintf(stderr, "objective cache tests passed\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>   // for max, min
+#include <atomic>      // for atomic
+#include <cstddef>     // for size_t
+#include <exception>   // for exception_ptr, current_exception, rethrow_exception
+#include <functional>  // for function
+#include <mutex>       // for mutex, lock_guard
+#include <thread>      // for thread
+#include <vector>      // for vector
+
+// requested if it's positive, otherwise one thread per core
+inline int NumThreads(const int requested) {
+  return requested > 0 ? requested
+                       : static_cast<int>(std::max(1U, std::thread::hardware_concurrency()));
+}
+
+// Run task(k) for every k in [0, count) on up to num_threads threads, the calling one included.
+// The first exception thrown by a task is rethrown here.
+inline void ParallelFor(const size_t count, const int num_threads,
+                        const std::function<void(size_t)> &task) {
+  std::atomic<size_t> next{0};
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  auto work = [&]() {
+    try {
+      for (size_t k = next++; k < count; k = next++) {
+        task(k);
+      }
+    } catch (...) {
+      const std::lock_guard<std::mutex> lock(error_mutex);
+      if (!error) {
+        error = std::current_exception();
+      }
+      next = count;
+    }
+  };
+  std::vector<std::thread> threads;
+  const size_t num_helpers = std::min(count, static_cast<size_t>(std::max(1, num_threads))) - 1;
+  for (size_t k = 0; count > 0 && k < num_helpers; k++) {
+    threads.emplace_back(work);
+  }
+  work();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
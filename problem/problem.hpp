@@ -1,56 +1,335 @@
 #pragma once
 
-#include <algorithm>           // for max
+#include <algorithm>           // for max, min
+#include <cstddef>             // for size_t
+#include <cstdint>             // for int64_t
 #include <eigen3/Eigen/Dense>  // for Matrix
 #include <glm/glm.hpp>         // for dvec3
+#include <limits>              // for numeric_limits
+#include <numeric>             // for accumulate
+#include <random>              // for mt19937_64, uniform_int_distribution
+#include <stdexcept>           // for runtime_error
+#include <string>              // for string, to_string
 #include <vector>              // for vector
 
 #include "bb3d/assert.hpp"        // for ASSERT
+#include "problem/aero.hpp"       // for AeroIntegrator, AeroParameters
 #include "problem/backboard.hpp"  // for Backboard
-#include "problem/shot.hpp"       // for Sample, Bounce
+#include "problem/collision.hpp"  // for BallCollisions, BallParameters, Contact
+#include "problem/hoop.hpp"       // for Hoop
+#include "problem/parallel.hpp"   // for ParallelFor
+#include "problem/shot.hpp"       // for Sample, Bounce, Shot, SquaredMiss
+#include "problem/shot_set.hpp"   // for ShotSet
 
 template <int NX, int NY>
 class Problem {
  public:
+  // The lowest interior bounce point of an NU x NV grid (largest z, since z is down). Designs only
+  // move control points in y, so this is the same for every design.
   template <int NU, int NV>
-  static std::vector<Sample> ComputeShots(const Eigen::Matrix<glm::dvec3, NX, NY> &control_points) {
+  static double MaxBounceZ() {
+    return CheckBounceGrid(Backboard<NX, NY>::template Interpolate<NU, NV>(
+        Backboard<NX, NY>::ToControlPoints(Eigen::Matrix<double, NX, NY>::Zero())));
+  }
+
+  // Shot assumes every shot comes up to its bounce point. Throws std::runtime_error naming the
+  // first shot point of shot_set (loaded from path) that isn't below max_bounce_z.
+  static void CheckShotsBelowBounces(const ShotSet &shot_set, const double max_bounce_z,
+                                     const std::string &path) {
+    for (size_t k = 0; k < shot_set.Size(); k++) {
+      if (!(shot_set.Point(k).z > max_bounce_z)) {
+        throw std::runtime_error(path + " has shot point " + std::to_string(k) +
+                                 " at or above a bounce point (z must be > " +
+                                 std::to_string(max_bounce_z) + ")");
+      }
+    }
+  }
+
+  template <int NU, int NV>
+  static std::vector<Sample> ComputeShots(const Eigen::Matrix<glm::dvec3, NX, NY> &control_points,
+                                          const ShotSet &shot_set) {
     Surface surface = Backboard<NX, NY>::template Interpolate<NU, NV>(control_points);
     const Eigen::Matrix<glm::dvec3, NU, NV> &bounce_points = surface.position;
 
     std::vector<Sample> result;
+    result.reserve(shot_set.Size() * (NU - 2) * (NV - 2));
 
-    const int num_sp_x = 5;
-    const int num_sp_y = 4;
-    for (int k_sp_x = 0; k_sp_x < num_sp_x; k_sp_x++) {
-      const double sp_x = k_sp_x / static_cast<double>(num_sp_x - 1);
-      for (int k_sp_y = 0; k_sp_y < num_sp_y; k_sp_y++) {
-        const double sp_y = k_sp_y / static_cast<double>(num_sp_y - 1);
+    for (size_t k_sp = 0; k_sp < shot_set.Size(); k_sp++) {
+      const glm::dvec3 shot_point = shot_set.Point(k_sp);
 
-        const glm::dvec3 shot_point(1.5 * (2 * sp_x + -1), 3 + sp_y * 2, 0);
+      ASSERT(NU > 2);
+      ASSERT(NV > 2);
+      for (int ku = 1; ku < NU - 1; ku++) {
+        for (int kv = 1; kv < NV - 1; kv++) {
+          result.push_back(Sample(shot_point, bounce_points(ku, kv), surface.normal(ku, kv)));
+        }
+      }
+    }
+    return result;
+  }
+
+  // Same as summing over ComputeShots, but streams through the shot set's arrays kShotBlock shots
+  // at a time without materializing any samples, so memory use doesn't grow with the number of
+  // shots. Each block is read once per bounce point while it's still in L1. Blocks are spread over
+  // num_threads threads, and the result doesn't depend on how many there are.
+  template <int NU, int NV>
+  static double ObjectiveFunction(const Eigen::Matrix<glm::dvec3, NX, NY> &control_points,
+                                  const ShotSet &shot_set, const int num_threads = 1) {
+    ASSERT(NU > 2);
+    ASSERT(NV > 2);
+    Surface surface = Backboard<NX, NY>::template Interpolate<NU, NV>(control_points);
+    const double max_bounce_z = CheckBounceGrid(surface);
 
-        ASSERT(NU > 2);
-        ASSERT(NV > 2);
+    const float *xs = shot_set.X();
+    const float *ys = shot_set.Y();
+    const float *zs = shot_set.Z();
+    return SumOverShotBlocks(shot_set, num_threads, [&](const size_t begin, const size_t end) {
+      for (size_t k = begin; k < end; k++) {
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        ASSERT(zs[k] > max_bounce_z);
+      }
+      double objective = 0;
+      for (int ku = 1; ku < NU - 1; ku++) {
+        for (int kv = 1; kv < NV - 1; kv++) {
+          const glm::dvec3 &bounce_point = surface.position(ku, kv);
+          const glm::dvec3 &normal = surface.normal(ku, kv);
+          for (size_t k = begin; k < end; k++) {
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+            objective += SquaredMiss(glm::dvec3(xs[k], ys[k], zs[k]), bounce_point, normal);
+          }
+        }
+      }
+      return objective;
+    });
+  }
+
+  // ObjectiveFunction with drag and Magnus forces on the ball after it leaves the backboard.
+  // The ball is assumed to arrive at the backboard exactly as in the drag-free model (the shooter
+  // compensates for drag on the way in) and only the outgoing flight is integrated, one shot
+  // point's worth of bounces per batch. A ball that never comes down through the rim plane, because
+  // it bounced off below the rim or was still in the air at max_time, scores at least as badly as
+  // landing on the rim.
+  template <int NU, int NV>
+  static double AeroObjectiveFunction(const Eigen::Matrix<glm::dvec3, NX, NY> &control_points,
+                                      const ShotSet &shot_set, const AeroParameters &aero,
+                                      const int num_threads = 1) {
+    ASSERT(NU > 2);
+    ASSERT(NV > 2);
+    Surface surface = Backboard<NX, NY>::template Interpolate<NU, NV>(control_points);
+    const AeroIntegrator integrator(aero);
+    const glm::dvec3 rim_center = Hoop::RimCenter();
+
+    return SumOverShotBlocks(shot_set, num_threads, [&](const size_t begin, const size_t end) {
+      std::vector<glm::dvec3> positions;
+      std::vector<glm::dvec3> velocities;
+      std::vector<glm::dvec3> landing_points;
+      std::vector<bool> through_rim;
+      positions.reserve((NU - 2) * (NV - 2));
+      velocities.reserve((NU - 2) * (NV - 2));
+
+      double objective = 0;
+      for (size_t k_sp = begin; k_sp < end; k_sp++) {
+        const glm::dvec3 shot_point = shot_set.Point(k_sp);
+        positions.clear();
+        velocities.clear();
         for (int ku = 1; ku < NU - 1; ku++) {
           for (int kv = 1; kv < NV - 1; kv++) {
-            result.push_back(Sample(shot_point, bounce_points(ku, kv), surface.normal(ku, kv)));
+            const Shot shot(shot_point, surface.position(ku, kv));
+            positions.push_back(surface.position(ku, kv));
+            velocities.push_back(glm::reflect(shot.BounceVel(), surface.normal(ku, kv)));
           }
         }
+        integrator.LandingPoints(positions, velocities, landing_points, through_rim);
+        for (size_t k = 0; k < landing_points.size(); k++) {
+          const double dx = landing_points[k].x - rim_center.x;
+          const double dy = landing_points[k].y - rim_center.y;
+          const double squared_miss = dx * dx + dy * dy;
+          objective += through_rim[k] ? squared_miss : std::max(squared_miss, kRimLandingPenalty);
+        }
+      }
+      return objective;
+    });
+  }
+
+  // Where each sample of ComputeShots lands, in the same order, with the outgoing flight integrated
+  // as in AeroObjectiveFunction. If paths isn't null it also gets each flight, for drawing.
+  template <int NU, int NV>
+  static std::vector<glm::dvec3> ComputeAeroLandings(
+      const Eigen::Matrix<glm::dvec3, NX, NY> &control_points, const ShotSet &shot_set,
+      const AeroParameters &aero, std::vector<std::vector<glm::dvec3> > *paths = nullptr) {
+    ASSERT(NU > 2);
+    ASSERT(NV > 2);
+    Surface surface = Backboard<NX, NY>::template Interpolate<NU, NV>(control_points);
+    std::vector<glm::dvec3> positions;
+    std::vector<glm::dvec3> velocities;
+    positions.reserve(shot_set.Size() * (NU - 2) * (NV - 2));
+    velocities.reserve(shot_set.Size() * (NU - 2) * (NV - 2));
+    for (size_t k_sp = 0; k_sp < shot_set.Size(); k_sp++) {
+      const glm::dvec3 shot_point = shot_set.Point(k_sp);
+      for (int ku = 1; ku < NU - 1; ku++) {
+        for (int kv = 1; kv < NV - 1; kv++) {
+          const Shot shot(shot_point, surface.position(ku, kv));
+          positions.push_back(surface.position(ku, kv));
+          velocities.push_back(glm::reflect(shot.BounceVel(), surface.normal(ku, kv)));
+        }
       }
     }
-    return result;
+    std::vector<glm::dvec3> landing_points;
+    std::vector<bool> through_rim;
+    AeroIntegrator(aero).LandingPoints(positions, velocities, landing_points, through_rim, paths);
+    return landing_points;
   }
 
+  // ObjectiveFunction for a ball of finite radius. A shot that touches the rim or comes back into
+  // the board on its way down scores as badly as landing on the rim, however close to the center
+  // it would have come down. Samples that already score worse than that are never checked.
   template <int NU, int NV>
-  static double ObjectiveFunction(const Eigen::Matrix<glm::dvec3, NX, NY> &control_points) {
-    std::vector<Sample> samples = ComputeShots<NU, NV>(control_points);
-    double objective = 0;
-    for (const Sample &sample : samples) {
+  static double FiniteBallObjectiveFunction(
+      const Eigen::Matrix<glm::dvec3, NX, NY> &control_points, const ShotSet &shot_set,
+      const BallParameters &ball, const int num_threads = 1) {
+    ASSERT(NU > 2);
+    ASSERT(NV > 2);
+    Surface surface = Backboard<NX, NY>::template Interpolate<NU, NV>(control_points);
+    const BallCollisions<NU, NV> collisions(surface, ball);
+
+    return SumOverShotBlocks(shot_set, num_threads, [&](const size_t begin, const size_t end) {
+      double objective = 0;
+      for (size_t k_sp = begin; k_sp < end; k_sp++) {
+        const glm::dvec3 shot_point = shot_set.Point(k_sp);
+        for (int ku = 1; ku < NU - 1; ku++) {
+          for (int kv = 1; kv < NV - 1; kv++) {
+            const Sample sample(shot_point, surface.position(ku, kv), surface.normal(ku, kv));
+            ASSERT(!sample.bounce_.lower_than_hoop_);
+            const double xydist = sample.bounce_.XYDistanceFromHoop();
+            double squared_miss = xydist * xydist;
+            if (squared_miss < kRimLandingPenalty &&
+                collisions.Check(sample.bounce_) != Contact::kNone) {
+              squared_miss = kRimLandingPenalty;
+            }
+            objective += squared_miss;
+          }
+        }
+      }
+      return objective;
+    });
+  }
+
+  enum class Sampling {
+    // Every (shot point, bounce point) pair is equally likely.
+    kUniform,
+    // The shot set is split into strata of consecutive shot points, batch_size of them or one per
+    // shot point if there are fewer, and each stratum gets its share of the batch, so no part of
+    // the shot set is ever left out.
+    kStratified,
+  };
+
+  // Unbiased estimate of ObjectiveFunction from batch_size randomly chosen (shot point, bounce
+  // point) pairs, drawn with replacement. Cost depends on batch_size, not on the number of shots.
+  template <int NU, int NV>
+  static double MinibatchObjectiveFunction(const Eigen::Matrix<glm::dvec3, NX, NY> &control_points,
+                                           const ShotSet &shot_set, const int batch_size,
+                                           const Sampling sampling, std::mt19937_64 &rng) {
+    ASSERT(NU > 2);
+    ASSERT(NV > 2);
+    ASSERT(batch_size > 0);
+    Surface surface = Backboard<NX, NY>::template Interpolate<NU, NV>(control_points);
+    ASSERT(shot_set.Size() > 0);
+    const auto num_shot_points = static_cast<int64_t>(shot_set.Size());
+    constexpr int num_bounce_points = (NU - 2) * (NV - 2);
+
+    std::uniform_int_distribution<int> random_bounce_point(0, num_bounce_points - 1);
+    auto squared_miss = [&surface, &shot_set, &random_bounce_point, &rng](int64_t k_sp) {
+      const int k_bp = random_bounce_point(rng);
+      const int ku = 1 + k_bp / (NV - 2);
+      const int kv = 1 + k_bp % (NV - 2);
+      const Sample sample(shot_set.Point(static_cast<size_t>(k_sp)), surface.position(ku, kv),
+                          surface.normal(ku, kv));
       ASSERT(!sample.bounce_.lower_than_hoop_);
-      double xydist = sample.bounce_.XYDistanceFromHoop();
-      objective += xydist * xydist;
+      const double xydist = sample.bounce_.XYDistanceFromHoop();
+      return xydist * xydist;
+    };
+
+    double objective = 0;
+    switch (sampling) {
+      case Sampling::kUniform: {
+        std::uniform_int_distribution<int64_t> random_shot_point(0, num_shot_points - 1);
+        for (int k = 0; k < batch_size; k++) {
+          objective += squared_miss(random_shot_point(rng));
+        }
+        objective *= static_cast<double>(num_shot_points) * num_bounce_points /
+                     static_cast<double>(batch_size);
+        break;
+      }
+      case Sampling::kStratified: {
+        if (batch_size < num_shot_points) {
+          // One shot point from each stratum, weighted by the stratum's size.
+          for (int64_t stratum = 0; stratum < batch_size; stratum++) {
+            const int64_t begin = stratum * num_shot_points / batch_size;
+            const int64_t end = (stratum + 1) * num_shot_points / batch_size;
+            const int64_t k_sp = std::uniform_int_distribution<int64_t>(begin, end - 1)(rng);
+            objective += static_cast<double>(end - begin) * squared_miss(k_sp);
+          }
+          objective *= num_bounce_points;
+          break;
+        }
+        // Every shot point is its own stratum, and gets batch_size / num_shot_points samples.
+        const int64_t per_shot_point = batch_size / num_shot_points;
+        // The rest of the batch buys one more sample for each of a run of shot points starting at
+        // a random one. Averaging per shot point keeps the estimate unbiased.
+        const int64_t leftover = batch_size - per_shot_point * num_shot_points;
+        int64_t first_extra = 0;
+        if (leftover > 0) {
+          first_extra = std::uniform_int_distribution<int64_t>(0, num_shot_points - 1)(rng);
+        }
+        for (int64_t k_sp = 0; k_sp < num_shot_points; k_sp++) {
+          const int64_t extra =
+              (k_sp - first_extra + num_shot_points) % num_shot_points < leftover ? 1 : 0;
+          double shot_point_objective = 0;
+          for (int64_t k = 0; k < per_shot_point + extra; k++) {
+            shot_point_objective += squared_miss(k_sp);
+          }
+          objective += shot_point_objective / static_cast<double>(per_shot_point + extra);
+        }
+        objective *= num_bounce_points;
+        break;
+      }
     }
     return objective;
   }
 
  private:
+  // Shots per task of the objectives that sum over the whole shot set.
+  static constexpr size_t kShotBlock = 1024;
+
+  // block_sum(begin, end) summed over blocks of kShotBlock shots, which are spread over up to
+  // num_threads threads. The partial sums are added up in block order, so the result is the same
+  // however many threads there are.
+  template <typename BlockSum>
+  static double SumOverShotBlocks(const ShotSet &shot_set, const int num_threads,
+                                  const BlockSum &block_sum) {
+    const size_t num_blocks = (shot_set.Size() + kShotBlock - 1) / kShotBlock;
+    std::vector<double> partial(num_blocks, 0);
+    ParallelFor(num_blocks, num_threads, [&](const size_t block) {
+      const size_t begin = block * kShotBlock;
+      partial[block] = block_sum(begin, std::min(shot_set.Size(), begin + kShotBlock));
+    });
+    return std::accumulate(partial.begin(), partial.end(), 0.0);
+  }
+
+  // What SquaredMiss leaves to its caller about the bounce points: every interior one is above the
+  // rim. Returns the largest z among them, which every shot point has to be below.
+  template <int NU, int NV>
+  static double CheckBounceGrid(const Surface<NU, NV> &surface) {
+    double max_z = -std::numeric_limits<double>::infinity();
+    for (int ku = 1; ku < NU - 1; ku++) {
+      for (int kv = 1; kv < NV - 1; kv++) {
+        ASSERT(Hoop::kRimHeight + surface.position(ku, kv).z < 0);
+        max_z = std::max(max_z, surface.position(ku, kv).z);
+      }
+    }
+    return max_z;
+  }
+
+  // Squared miss of a ball landing on the rim.
+  static constexpr double kRimLandingPenalty = 0.25 * Hoop::kRimDiameter * Hoop::kRimDiameter;
 };
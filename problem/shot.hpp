@@ -131,3 +131,29 @@ class Sample {
   Bounce bounce_;
   double objective{};
 };
+
+// Squared horizontal distance from the rim center to where a shot from shot_point lands after
+// bouncing off bounce_point, the same as Sample's bounce_.XYDistanceFromHoop() squared. Nothing is
+// checked or kept, so that it's cheap enough for the innermost loop: the caller makes sure the
+// shot point is below the bounce point and the bounce point is above the rim.
+inline double SquaredMiss(const glm::dvec3 &shot_point, const glm::dvec3 &bounce_point,
+                          const glm::dvec3 &normal) {
+  // Shot
+  const double vz_bounce = 0.5;
+  const double vz_shot =
+      -sqrt(vz_bounce * vz_bounce - 2 * g_accel * (bounce_point.z - shot_point.z));
+  const double bounce_time = (vz_bounce - vz_shot) / g_accel;
+  const glm::dvec3 incoming_velocity((bounce_point.x - shot_point.x) / bounce_time,
+                                     (bounce_point.y - shot_point.y) / bounce_time, vz_bounce);
+
+  // Bounce
+  const glm::dvec3 outgoing_velocity = glm::reflect(incoming_velocity, normal);
+  const double vz0 = outgoing_velocity.z;
+  const double pz0 = Hoop::kRimHeight + bounce_point.z;
+  const double land_time = (-vz0 + sqrt(vz0 * vz0 - 2 * pz0 * g_accel)) / g_accel;
+
+  const glm::dvec3 rim_center = Hoop::RimCenter();
+  const double dx = rim_center.x - (bounce_point.x + outgoing_velocity.x * land_time);
+  const double dy = rim_center.y - (bounce_point.y + outgoing_velocity.y * land_time);
+  return dx * dx + dy * dy;
+}
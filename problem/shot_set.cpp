@@ -0,0 +1,191 @@
+#include "problem/shot_set.hpp"
+
+#include <fcntl.h>     // for open, O_RDONLY
+#include <sys/mman.h>  // for mmap, munmap, madvise, MAP_FAILED, MAP_PRIVATE, PROT_READ, MADV_...
+#include <sys/stat.h>  // for fstat, stat
+#include <unistd.h>    // for close
+
+#include <cmath>      // for isfinite
+#include <cstring>    // for memcmp, memcpy
+#include <stdexcept>  // for runtime_error
+#include <utility>    // for move
+
+#include "bb3d/assert.hpp"  // for ASSERT
+
+static constexpr char kMagic[8] = {'B', 'B', 'S', 'H', 'O', 'T', '0', '1'};
+static constexpr size_t kAlignment = 64;
+
+struct Header {
+  char magic[8];
+  uint64_t num_shots;
+  uint64_t x_offset;
+  uint64_t y_offset;
+  uint64_t z_offset;
+};
+
+ShotSet ShotSet::Grid() {
+  std::vector<glm::dvec3> shot_points;
+
+  const int num_sp_x = 5;
+  const int num_sp_y = 4;
+  for (int k_sp_x = 0; k_sp_x < num_sp_x; k_sp_x++) {
+    const double sp_x = k_sp_x / static_cast<double>(num_sp_x - 1);
+    for (int k_sp_y = 0; k_sp_y < num_sp_y; k_sp_y++) {
+      const double sp_y = k_sp_y / static_cast<double>(num_sp_y - 1);
+
+      shot_points.emplace_back(1.5 * (2 * sp_x + -1), 3 + sp_y * 2, 0);
+    }
+  }
+  return FromPoints(shot_points);
+}
+
+ShotSet ShotSet::FromPoints(const std::vector<glm::dvec3> &points) {
+  ShotSet shot_set;
+  const size_t n = points.size();
+  shot_set.size_ = n;
+  shot_set.owned_.resize(3 * n);
+  for (size_t k = 0; k < n; k++) {
+    shot_set.owned_[k] = static_cast<float>(points[k].x);
+    shot_set.owned_[n + k] = static_cast<float>(points[k].y);
+    shot_set.owned_[2 * n + k] = static_cast<float>(points[k].z);
+  }
+  shot_set.x_ = shot_set.owned_.data();
+  shot_set.y_ = shot_set.x_ + n;  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  shot_set.z_ = shot_set.y_ + n;  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  return shot_set;
+}
+
+ShotSet ShotSet::View(const float *x, const float *y, const float *z, const size_t size) {
+  ShotSet shot_set;
+  shot_set.size_ = size;
+  shot_set.x_ = x;
+  shot_set.y_ = y;
+  shot_set.z_ = z;
+  return shot_set;
+}
+
+ShotSet ShotSet::Load(const std::string &path) {
+  const int fd = open(path.c_str(), O_RDONLY);  // NOLINT(cppcoreguidelines-pro-type-vararg)
+  if (fd < 0) {
+    throw std::runtime_error("can't open shot set " + path);
+  }
+  struct stat file_stat {};
+  if (fstat(fd, &file_stat) != 0 || static_cast<size_t>(file_stat.st_size) < sizeof(Header)) {
+    close(fd);
+    throw std::runtime_error(path + " is too short to be a shot set");
+  }
+  const auto length = static_cast<size_t>(file_stat.st_size);
+  void *mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {  // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+    throw std::runtime_error("can't map shot set " + path);
+  }
+  // The objective streams through the arrays front to back.
+  madvise(mapped, length, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+  ShotSet shot_set;
+  shot_set.mapped_ = mapped;
+  shot_set.mapped_length_ = length;
+
+  Header header{};
+  memcpy(&header, mapped, sizeof(header));
+  if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    throw std::runtime_error(path + " is not a shot set");
+  }
+  const uint64_t n = header.num_shots;
+  const uint64_t array_bytes = n * sizeof(float);
+  for (const uint64_t offset : {header.x_offset, header.y_offset, header.z_offset}) {
+    if (n > length / sizeof(float) || offset % kAlignment != 0 || offset < sizeof(Header) ||
+        offset > length || length - offset < array_bytes) {
+      throw std::runtime_error(path + " has a corrupt shot set header");
+    }
+  }
+
+  const auto *base = static_cast<const char *>(mapped);
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  shot_set.x_ = reinterpret_cast<const float *>(base + header.x_offset);
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  shot_set.y_ = reinterpret_cast<const float *>(base + header.y_offset);
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  shot_set.z_ = reinterpret_cast<const float *>(base + header.z_offset);
+  shot_set.size_ = n;
+
+  for (size_t k = 0; k < shot_set.size_; k++) {
+    const glm::dvec3 point = shot_set.Point(k);
+    if (!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z)) {
+      throw std::runtime_error(path + " has a non-finite shot point at index " +
+                               std::to_string(k));
+    }
+  }
+  return shot_set;
+}
+
+ShotSet::ShotSet(ShotSet &&other) noexcept { *this = std::move(other); }
+
+ShotSet &ShotSet::operator=(ShotSet &&other) noexcept {
+  if (this != &other) {
+    Release();
+    size_ = other.size_;
+    x_ = other.x_;
+    y_ = other.y_;
+    z_ = other.z_;
+    fingerprint_ = other.fingerprint_.load();
+    // Moving a vector keeps its buffer, so the array pointers stay valid.
+    owned_ = std::move(other.owned_);
+    mapped_ = other.mapped_;
+    mapped_length_ = other.mapped_length_;
+
+    other.size_ = 0;
+    other.x_ = nullptr;
+    other.y_ = nullptr;
+    other.z_ = nullptr;
+    other.mapped_ = nullptr;
+    other.mapped_length_ = 0;
+  }
+  return *this;
+}
+
+ShotSet::~ShotSet() { Release(); }
+
+void ShotSet::Release() {
+  if (mapped_ != nullptr) {
+    munmap(mapped_, mapped_length_);
+    mapped_ = nullptr;
+    mapped_length_ = 0;
+  }
+  owned_.clear();
+}
+
+ShotSet ShotSet::Subsample(const size_t max_size) const {
+  ASSERT(max_size > 0);
+  std::vector<glm::dvec3> points;
+  const size_t stride = (size_ + max_size - 1) / max_size;
+  for (size_t k = 0; k < size_; k += stride) {
+    points.push_back(Point(k));
+  }
+  return FromPoints(points);
+}
+
+uint64_t ShotSet::Fingerprint() const {
+  uint64_t fingerprint = fingerprint_.load(std::memory_order_relaxed);
+  if (fingerprint == 0) {
+    fingerprint = ComputeFingerprint();
+    fingerprint_.store(fingerprint, std::memory_order_relaxed);
+  }
+  return fingerprint;
+}
+
+uint64_t ShotSet::ComputeFingerprint() const {
+  // FNV-1a over the raw coordinates
+  uint64_t hash = 14695981039346656037ULL;
+  for (const float *array : {x_, y_, z_}) {
+    for (size_t k = 0; k < size_; k++) {
+      uint32_t bits{};
+      memcpy(&bits, &array[k], sizeof(bits));  // NOLINT
+      hash ^= bits;
+      hash *= 1099511628211ULL;
+    }
+  }
+  // 0 means not computed yet
+  return hash != 0 ? hash : 1;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>       // for atomic
+#include <cstddef>      // for size_t
+#include <cstdint>      // for uint64_t
+#include <glm/glm.hpp>  // for dvec3
+#include <string>       // for string
+#include <vector>       // for vector
+
+// Shot release points in structure-of-arrays layout.
+//
+// A shot set is either built in memory or memory-mapped read-only from a shot set file, so a
+// million shots cost 12 MB of page cache and nothing else. Points are in the problem frame: x
+// across the court, y out from the backboard, z down from the floor (so release points have z < 0).
+//
+// Shot set file layout (native endian, which is little-endian everywhere we run):
+//   char[8]  magic "BBSHOT01"
+//   uint64   number of shots N
+//   uint64   byte offset of the x array, then of the y array, then of the z array
+//   float32  x[N], y[N], z[N], each array starting on a 64 byte boundary
+// problem/shot_set.py converts tracking data to this format.
+class ShotSet {
+ public:
+  // The original 5x4 grid over a 3x2 meter patch of court.
+  static ShotSet Grid();
+  static ShotSet FromPoints(const std::vector<glm::dvec3> &points);
+  // Throws std::runtime_error if the file can't be mapped or isn't a valid shot set.
+  static ShotSet Load(const std::string &path);
+  // Borrow arrays owned by somebody else (e.g. NumPy), who must keep them alive and unchanged.
+  static ShotSet View(const float *x, const float *y, const float *z, size_t size);
+
+  ShotSet(ShotSet &&other) noexcept;
+  ShotSet &operator=(ShotSet &&other) noexcept;
+  ShotSet(const ShotSet &) = delete;
+  ShotSet &operator=(const ShotSet &) = delete;
+  ~ShotSet();
+
+  [[nodiscard]] size_t Size() const { return size_; }
+  [[nodiscard]] glm::dvec3 Point(const size_t k) const {
+    return {x_[k], y_[k], z_[k]};  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  }
+  [[nodiscard]] const float *X() const { return x_; }
+  [[nodiscard]] const float *Y() const { return y_; }
+  [[nodiscard]] const float *Z() const { return z_; }
+
+  // An evenly strided subset of at most max_size shots, for drawing.
+  [[nodiscard]] ShotSet Subsample(size_t max_size) const;
+
+  // Hash of the contents, so that results computed on one shot set are never reused on another.
+  // It takes a pass over every coordinate, so it's only computed the first time it's asked for.
+  [[nodiscard]] uint64_t Fingerprint() const;
+
+ private:
+  ShotSet() = default;
+  void Release();
+  [[nodiscard]] uint64_t ComputeFingerprint() const;
+
+  size_t size_ = 0;
+  const float *x_ = nullptr;
+  const float *y_ = nullptr;
+  const float *z_ = nullptr;
+  // 0 until computed. Threads racing to compute it store the same value.
+  mutable std::atomic<uint64_t> fingerprint_{0};
+
+  // At most one of these backs the arrays; neither does for a View.
+  std::vector<float> owned_;
+  void *mapped_ = nullptr;
+  size_t mapped_length_ = 0;
+};
@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""
+Write shot set files for `vis --shot-set=PATH`, see problem/shot_set.hpp for the layout.
+
+Input is CSV with one shot per row: x, y, release_height in meters, where x runs across the court
+through the center of the rim, y is the distance out from the backboard and release_height is
+measured up from the floor. Rows starting with '#' and a non-numeric header row are skipped.
+
+  shot_set.py shots.csv shots.bin
+  shot_set.py --random 100000 shots.bin   # uniform over the half court, for testing
+"""
+
+import argparse
+import array
+import csv
+import random
+import struct
+import sys
+
+MAGIC = b'BBSHOT01'
+ALIGNMENT = 64
+HEADER_FORMAT = '<8s4Q'
+
+# half court, in the problem frame
+HALF_COURT_WIDTH = 15.24
+HALF_COURT_LENGTH = 14.33
+MIN_DISTANCE_FROM_BACKBOARD = 1.5
+
+
+def align(offset):
+  return (offset + ALIGNMENT - 1) // ALIGNMENT * ALIGNMENT
+
+def read_csv(path):
+  xs, ys, zs = [], [], []
+  with open(path, newline='') as f:
+    for row in csv.reader(f):
+      if not row or row[0].lstrip().startswith('#'):
+        continue
+      try:
+        x, y, release_height = (float(v) for v in row[:3])
+      except ValueError:
+        continue
+      xs.append(x)
+      ys.append(y)
+      # the problem frame's z axis points down
+      zs.append(-release_height)
+  return xs, ys, zs
+
+def random_shots(n, seed):
+  rng = random.Random(seed)
+  xs = [rng.uniform(-HALF_COURT_WIDTH/2, HALF_COURT_WIDTH/2) for _ in range(n)]
+  ys = [rng.uniform(MIN_DISTANCE_FROM_BACKBOARD, HALF_COURT_LENGTH) for _ in range(n)]
+  zs = [-rng.uniform(1.8, 2.6) for _ in range(n)]
+  return xs, ys, zs
+
+def write_shot_set(path, xs, ys, zs):
+  n = len(xs)
+  header_size = struct.calcsize(HEADER_FORMAT)
+  x_offset = align(header_size)
+  y_offset = align(x_offset + 4*n)
+  z_offset = align(y_offset + 4*n)
+
+  with open(path, 'wb') as f:
+    f.write(struct.pack(HEADER_FORMAT, MAGIC, n, x_offset, y_offset, z_offset))
+    for offset, values in [(x_offset, xs), (y_offset, ys), (z_offset, zs)]:
+      f.write(b'\0' * (offset - f.tell()))
+      floats = array.array('f', values)
+      if sys.byteorder != 'little':
+        floats.byteswap()
+      floats.tofile(f)
+
+def main():
+  parser = argparse.ArgumentParser(description=__doc__,
+                                   formatter_class=argparse.RawDescriptionHelpFormatter)
+  parser.add_argument('input', nargs='?', help='CSV of x, y, release_height')
+  parser.add_argument('output', help='shot set file to write')
+  parser.add_argument('--random', type=int, metavar='N', help='generate N random shots instead')
+  parser.add_argument('--seed', type=int, default=0)
+  args = parser.parse_args()
+
+  if args.random is not None:
+    xs, ys, zs = random_shots(args.random, args.seed)
+  elif args.input is not None:
+    xs, ys, zs = read_csv(args.input)
+  else:
+    parser.error('need an input CSV or --random N')
+
+  write_shot_set(args.output, xs, ys, zs)
+  print('wrote {} shots to {}'.format(len(xs), args.output))
+
+if __name__=='__main__':
+  main()
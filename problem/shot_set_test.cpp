@@ -0,0 +1,192 @@
+#include <cmath>         // for fabs
+#include <cstdint>       // for uint64_t
+#include <cstdio>        // for fprintf, stderr, fopen, fwrite, fclose, FILE
+#include <cstdlib>       // for getenv, EXIT_SUCCESS
+#include <cstring>       // for memcpy
+#include <filesystem>    // for create_directories, remove_all
+#include <functional>    // for function
+#include <glm/glm.hpp>   // for dvec3
+#include <limits>        // for numeric_limits
+#include <random>        // for mt19937_64, uniform_real_distribution
+#include <stdexcept>     // for runtime_error
+#include <string>        // for string
+#include <vector>        // for vector
+
+#include "bb3d/assert.hpp"        // for ASSERT
+#include "problem/backboard.hpp"  // for Backboard
+#include "problem/config.hpp"     // for NX, NY, NU_OBJ, NV_OBJ
+#include "problem/problem.hpp"    // for Problem
+#include "problem/shot.hpp"       // for Sample
+#include "problem/shot_set.hpp"   // for ShotSet
+
+// The layout documented in shot_set.hpp.
+struct FileHeader {
+  char magic[8] = {'B', 'B', 'S', 'H', 'O', 'T', '0', '1'};
+  uint64_t num_shots = 0;
+  uint64_t x_offset = 0;
+  uint64_t y_offset = 0;
+  uint64_t z_offset = 0;
+};
+
+static std::string TestDir() {
+  // bazel test gives every test its own scratch directory
+  const char *tmpdir = std::getenv("TEST_TMPDIR");
+  const std::string dir = std::string(tmpdir != nullptr ? tmpdir : "/tmp") + "/shot_set";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  return dir;
+}
+
+// Write points as a shot set file, letting corrupt() spoil the header first.
+static void WriteShotSet(const std::string &path, const std::vector<glm::dvec3> &points,
+                         const std::function<void(FileHeader *)> &corrupt = nullptr) {
+  const uint64_t n = points.size();
+  const uint64_t array_stride = (n * sizeof(float) + 63) / 64 * 64;
+  FileHeader header;
+  header.num_shots = n;
+  header.x_offset = 64;
+  header.y_offset = header.x_offset + array_stride;
+  header.z_offset = header.y_offset + array_stride;
+  std::vector<char> contents(header.z_offset + array_stride, 0);
+  for (size_t k = 0; k < n; k++) {
+    const float x = static_cast<float>(points[k].x);
+    const float y = static_cast<float>(points[k].y);
+    const float z = static_cast<float>(points[k].z);
+    memcpy(&contents[header.x_offset + k * sizeof(float)], &x, sizeof(float));
+    memcpy(&contents[header.y_offset + k * sizeof(float)], &y, sizeof(float));
+    memcpy(&contents[header.z_offset + k * sizeof(float)], &z, sizeof(float));
+  }
+  if (corrupt) {
+    corrupt(&header);
+  }
+  memcpy(contents.data(), &header, sizeof(header));
+  FILE *file = fopen(path.c_str(), "wb");
+  ASSERT(file != nullptr);
+  ASSERT(fwrite(contents.data(), 1, contents.size(), file) == contents.size());
+  ASSERT(fclose(file) == 0);
+}
+
+// Whether f throws a runtime_error whose message contains expected.
+static bool ThrowsWith(const std::function<void()> &f, const std::string &expected) {
+  try {
+    f();
+  } catch (const std::runtime_error &e) {
+    const std::string message = e.what();
+    if (message.find(expected) == std::string::npos) {
+      fprintf(stderr, "expected \"%s\" in \"%s\"\n", expected.c_str(), message.c_str());
+      return false;
+    }
+    return true;
+  }
+  return false;
+}
+
+static std::vector<glm::dvec3> RandomPoints(const size_t n) {
+  std::mt19937_64 rng(0);
+  std::uniform_real_distribution<double> x(-7, 7);
+  std::uniform_real_distribution<double> y(0.5, 12);
+  std::uniform_real_distribution<double> z(-2.8, -1.5);
+  std::vector<glm::dvec3> points;
+  for (size_t k = 0; k < n; k++) {
+    points.emplace_back(x(rng), y(rng), z(rng));
+  }
+  return points;
+}
+
+static void TestLoad(const std::string &dir) {
+  const std::vector<glm::dvec3> points = RandomPoints(37);
+  const std::string path = dir + "/good.bbshot";
+  WriteShotSet(path, points);
+  const ShotSet loaded = ShotSet::Load(path);
+  const ShotSet built = ShotSet::FromPoints(points);
+  ASSERT(loaded.Size() == points.size());
+  for (size_t k = 0; k < points.size(); k++) {
+    ASSERT(loaded.Point(k) == built.Point(k));
+  }
+  ASSERT(loaded.Fingerprint() == built.Fingerprint());
+  ASSERT(ShotSet::FromPoints(RandomPoints(36)).Fingerprint() != built.Fingerprint());
+
+  const ShotSet subsample = loaded.Subsample(10);
+  ASSERT(subsample.Size() <= 10);
+  ASSERT(subsample.Point(1) == loaded.Point((points.size() + 9) / 10));
+}
+
+static void TestRejects(const std::string &dir) {
+  const std::vector<glm::dvec3> points = RandomPoints(20);
+  auto load_corrupt = [&dir, &points](const std::function<void(FileHeader *)> &corrupt) {
+    const std::string path = dir + "/corrupt.bbshot";
+    WriteShotSet(path, points, corrupt);
+    return [path]() { ShotSet::Load(path); };
+  };
+
+  ASSERT(ThrowsWith([&dir]() { ShotSet::Load(dir + "/missing.bbshot"); }, "can't open"));
+  {
+    const std::string path = dir + "/short.bbshot";
+    FILE *file = fopen(path.c_str(), "wb");
+    ASSERT(file != nullptr);
+    ASSERT(fwrite("BBSHOT01", 1, 8, file) == 8);
+    ASSERT(fclose(file) == 0);
+    ASSERT(ThrowsWith([&path]() { ShotSet::Load(path); }, "too short"));
+  }
+  ASSERT(ThrowsWith(load_corrupt([](FileHeader *header) { header->magic[7] = '2'; }),
+                    "is not a shot set"));
+  ASSERT(ThrowsWith(load_corrupt([](FileHeader *header) { header->y_offset += 4; }),
+                    "corrupt shot set header"));
+  ASSERT(ThrowsWith(load_corrupt([](FileHeader *header) { header->z_offset += 1024; }),
+                    "corrupt shot set header"));
+  ASSERT(ThrowsWith(load_corrupt([](FileHeader *header) { header->x_offset = 0; }),
+                    "corrupt shot set header"));
+  ASSERT(ThrowsWith(load_corrupt([](FileHeader *header) { header->num_shots = 1ULL << 62U; }),
+                    "corrupt shot set header"));
+
+  std::vector<glm::dvec3> nan_points = points;
+  nan_points[3].y = std::numeric_limits<double>::quiet_NaN();
+  WriteShotSet(dir + "/nan.bbshot", nan_points);
+  ASSERT(ThrowsWith([&dir]() { ShotSet::Load(dir + "/nan.bbshot"); },
+                    "non-finite shot point at index 3"));
+}
+
+static void TestShotsBelowBounces() {
+  const double max_bounce_z = Problem<NX, NY>::MaxBounceZ<NU_OBJ, NV_OBJ>();
+  // z is down, so shots must be further down than every bounce point, i.e. have greater z.
+  ASSERT(max_bounce_z < -3.05);
+  std::vector<glm::dvec3> points = RandomPoints(10);
+  Problem<NX, NY>::CheckShotsBelowBounces(ShotSet::FromPoints(points), max_bounce_z, "ok");
+  points[4].z = max_bounce_z - 0.1;
+  const ShotSet bad = ShotSet::FromPoints(points);
+  auto check_bad = [&bad, max_bounce_z]() {
+    Problem<NX, NY>::CheckShotsBelowBounces(bad, max_bounce_z, "bad");
+  };
+  ASSERT(ThrowsWith(check_bad, "bad has shot point 4 at or above a bounce point"));
+}
+
+// The streaming objective has to agree with the sum over every sample, for any thread count.
+static void TestObjectiveFunction() {
+  // a few blocks and a ragged last one
+  const ShotSet shot_set = ShotSet::FromPoints(RandomPoints(2500));
+  const auto control_points = Backboard<NX, NY>::Initialize();
+  double expected = 0;
+  for (const Sample &sample :
+       Problem<NX, NY>::ComputeShots<NU_OBJ, NV_OBJ>(control_points, shot_set)) {
+    const double xydist = sample.bounce_.XYDistanceFromHoop();
+    expected += xydist * xydist;
+  }
+  const double objective =
+      Problem<NX, NY>::ObjectiveFunction<NU_OBJ, NV_OBJ>(control_points, shot_set, 1);
+  ASSERT(std::fabs(objective - expected) <= 1e-12 * expected);
+  for (const int num_threads : {2, 3, 8}) {
+    const double threaded =
+        Problem<NX, NY>::ObjectiveFunction<NU_OBJ, NV_OBJ>(control_points, shot_set, num_threads);
+    ASSERT(threaded == objective);
+  }
+}
+
+int main() {
+  const std::string dir = TestDir();
+  TestLoad(dir);
+  TestRejects(dir);
+  TestShotsBelowBounces();
+  TestObjectiveFunction();
+  fprintf(stderr, "shot set tests passed\n");
+  return EXIT_SUCCESS;
+}
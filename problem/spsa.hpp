@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>   // for clamp
+#include <cmath>       // for pow, fabs
+#include <cstdint>     // for uint64_t
+#include <functional>  // for function
+#include <random>      // for mt19937_64, bernoulli_distribution
+#include <vector>      // for vector
+
+#include "bb3d/assert.hpp"  // for ASSERT
+
+// Simultaneous perturbation stochastic approximation (Spall).
+//
+// Every iteration costs two objective evaluations regardless of the number of design variables,
+// and it tolerates noisy objectives, which makes it a good match for minibatch objectives.
+// The objective is called as f(x, seed) and must be deterministic in seed. Both sides of a
+// perturbation are evaluated with the same seed (common random numbers) so that most of the
+// minibatch noise cancels out of the gradient estimate.
+struct SpsaOptions {
+  // Desired magnitude of the first steps, used to calibrate the step gain.
+  double initial_step = 0.1;
+  // Perturbation size c_k = c / (k + 1)^gamma.
+  double c = 0.05;
+  double gamma = 0.101;
+  // Step gain a_k = a / (k + 1 + big_a)^alpha, where a is calibrated from initial_step.
+  double big_a = 100;
+  double alpha = 0.602;
+  int calibration_iterations = 10;
+  int max_iterations = 5000;
+  double lower_bound = -10;
+  double upper_bound = 2;
+};
+
+using SpsaObjective = std::function<double(const std::vector<double> &, uint64_t)>;
+
+// Minimizes f within [lower_bound, upper_bound] starting from x, updating x in place. callback is
+// called after every iteration, and stops the run early by returning false.
+inline void Spsa(const SpsaObjective &f, std::vector<double> &x, const SpsaOptions &options,
+                 std::mt19937_64 &rng,
+                 const std::function<bool(int, const std::vector<double> &)> &callback) {
+  const size_t n = x.size();
+  ASSERT(n > 0);
+  std::bernoulli_distribution coin(0.5);
+  std::vector<double> delta(n);
+  std::vector<double> x_plus(n);
+  std::vector<double> x_minus(n);
+
+  ASSERT(options.lower_bound < options.upper_bound);
+  auto clamp = [&options](const double x_i) {
+    return std::clamp(x_i, options.lower_bound, options.upper_bound);
+  };
+
+  // Estimate g = (f(x + c*delta) - f(x - c*delta)) / (2*c*delta) into gradient. The objective is
+  // only ever evaluated within the bounds, so perturbations that would leave them are clamped, and
+  // each component is divided by the difference that was actually taken.
+  auto estimate_gradient = [&](const double c_k, std::vector<double> &gradient) {
+    for (size_t i = 0; i < n; i++) {
+      delta[i] = coin(rng) ? 1 : -1;
+      x_plus[i] = clamp(x[i] + c_k * delta[i]);
+      x_minus[i] = clamp(x[i] - c_k * delta[i]);
+    }
+    const uint64_t seed = rng();
+    const double df = f(x_plus, seed) - f(x_minus, seed);
+    for (size_t i = 0; i < n; i++) {
+      gradient[i] = df / (x_plus[i] - x_minus[i]);
+    }
+  };
+
+  // Calibrate the gain so that the first step has magnitude initial_step (Spall's recommendation).
+  // Components only share a magnitude while no perturbation is clamped at a bound, so average
+  // them all.
+  std::vector<double> gradient(n);
+  double mean_abs_gradient = 0;
+  for (int k = 0; k < options.calibration_iterations; k++) {
+    estimate_gradient(options.c, gradient);
+    for (const double g : gradient) {
+      mean_abs_gradient +=
+          std::fabs(g) / (static_cast<double>(n) * options.calibration_iterations);
+    }
+  }
+  if (mean_abs_gradient == 0) {
+    mean_abs_gradient = 1;
+  }
+  const double a =
+      options.initial_step * std::pow(options.big_a + 1, options.alpha) / mean_abs_gradient;
+
+  for (int k = 0; k < options.max_iterations; k++) {
+    const double a_k = a / std::pow(k + 1 + options.big_a, options.alpha);
+    const double c_k = options.c / std::pow(k + 1, options.gamma);
+    estimate_gradient(c_k, gradient);
+    for (size_t i = 0; i < n; i++) {
+      x[i] = clamp(x[i] - a_k * gradient[i]);
+    }
+    if (!callback(k, x)) {
+      return;
+    }
+  }
+}
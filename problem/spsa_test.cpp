@@ -0,0 +1,80 @@
+#include <algorithm>  // for max
+#include <cmath>      // for fabs
+#include <cstdint>    // for uint64_t
+#include <cstdio>     // for fprintf, stderr
+#include <cstdlib>    // for EXIT_SUCCESS
+#include <random>     // for mt19937_64, normal_distribution
+#include <vector>     // for vector
+
+#include "bb3d/assert.hpp"   // for ASSERT
+#include "problem/spsa.hpp"  // for Spsa, SpsaObjective, SpsaOptions
+
+// A noisy quadratic bowl, with the minimum of the last component beyond the upper bound.
+static void TestQuadratic() {
+  constexpr size_t kN = 24;
+  SpsaOptions options;
+  std::vector<double> target(kN);
+  for (size_t i = 0; i < kN; i++) {
+    target[i] = -1 + 0.05 * static_cast<double>(i);
+  }
+  target[kN - 1] = options.upper_bound + 1;
+
+  int evaluations = 0;
+  const SpsaObjective f = [&target, &options, &evaluations](const std::vector<double> &x,
+                                                            const uint64_t seed) {
+    evaluations++;
+    double objective = 0;
+    for (size_t i = 0; i < x.size(); i++) {
+      // only ever evaluated within the bounds
+      ASSERT(x[i] >= options.lower_bound && x[i] <= options.upper_bound);
+      // curvature varies between components
+      objective += (1 + 0.1 * static_cast<double>(i)) * (x[i] - target[i]) * (x[i] - target[i]);
+    }
+    // noise that depends only on the seed, like a minibatch's
+    std::mt19937_64 rng(seed);
+    return objective + std::normal_distribution<double>(0, 0.1)(rng);
+  };
+
+  std::vector<double> x(kN, 0);
+  std::mt19937_64 rng(0);
+  int iterations = 0;
+  Spsa(f, x, options, rng, [&iterations](int /*iteration*/, const std::vector<double> & /*x*/) {
+    iterations++;
+    return true;
+  });
+  ASSERT(iterations == options.max_iterations);
+  ASSERT(evaluations == 2 * (options.calibration_iterations + options.max_iterations));
+
+  double max_error = 0;
+  for (size_t i = 0; i + 1 < kN; i++) {
+    max_error = std::max(max_error, std::fabs(x[i] - target[i]));
+  }
+  // It starts up to 1 away, and the noise keeps it wandering around the minimum: the error ends up
+  // between 0.05 and 0.09 depending on the seed.
+  fprintf(stderr, "spsa on a quadratic: largest error %.4f\n", max_error);
+  ASSERT(max_error < 0.2);
+  ASSERT(x[kN - 1] == options.upper_bound);
+}
+
+// Returning false from the callback ends the run right there.
+static void TestStop() {
+  SpsaOptions options;
+  const SpsaObjective f = [](const std::vector<double> &x, uint64_t /*seed*/) {
+    return x[0] * x[0];
+  };
+  std::vector<double> x = {1.0};
+  std::mt19937_64 rng(0);
+  int last_iteration = -1;
+  Spsa(f, x, options, rng, [&last_iteration](const int iteration, const std::vector<double> &) {
+    last_iteration = iteration;
+    return iteration < 9;
+  });
+  ASSERT(last_iteration == 9);
+}
+
+int main() {
+  TestQuadratic();
+  TestStop();
+  fprintf(stderr, "spsa tests passed\n");
+  return EXIT_SUCCESS;
+}
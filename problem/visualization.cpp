@@ -2,13 +2,19 @@
 
 #include <GL/glew.h>  // for glPolygonMode, GL_LINE_STRIP, GL_FRONT_AND_BACK, GL_LINES
 
-#include <iostream>  // for operator<<, cerr, ostream, char_traits, endl, basic_ostream
-#include <string>    // for allocator, operator<<, string
+#include <algorithm>  // for max
+#include <iostream>   // for operator<<, cerr, ostream, char_traits, endl, basic_ostream
+#include <string>     // for allocator, operator<<, string
+#include <utility>    // for pair, make_pair
+#include <vector>     // for vector
 
 #include "bb3d/shader/cubemesh.hpp"  // for Cubemesh
 #include "bb3d/shader/gridmesh.hpp"  // for Gridmesh
 #include "bb3d/shader/lines.hpp"     // for Lines
 
+// How much each older epoch of the long-run heatmap counts in the recent view.
+static constexpr double kRecentLandingsDecay = 0.9;
+
 ProblemVisualization::ProblemVisualization()
     : backboard_vis_("image/awesomeface.png"), court_vis_("image/warriors_court.png") {
   control_points_vis_.SetPointSize(3);
@@ -60,6 +66,7 @@ void ProblemVisualization::Draw(const glm::mat4 &view, const glm::mat4 &proj) {
   if (histogram_on_) {
     histogram_vis_.Draw(view, proj);
   }
+  dirty_ = false;
 }
 
 static void DescribeState(const std::string &name, bool state) {
@@ -114,9 +121,66 @@ void ProblemVisualization::HandleKeyPress(const int key) {
       DescribeState("wireframe", wireframe_on_);
       break;
     }
+    case GLFW_KEY_D: {
+      if (heatmap_ == nullptr) {
+        return;
+      }
+      switch (histogram_view_) {
+        case HistogramView::kCurrent: {
+          histogram_view_ = HistogramView::kRecent;
+          std::cerr << "histogram of recent designs (drawn shots only)" << std::endl;
+          break;
+        }
+        case HistogramView::kRecent: {
+          histogram_view_ = HistogramView::kAllTime;
+          std::cerr << "histogram of every design so far (drawn shots only)" << std::endl;
+          break;
+        }
+        case HistogramView::kAllTime: {
+          histogram_view_ = HistogramView::kCurrent;
+          std::cerr << "histogram of the latest design" << std::endl;
+          break;
+        }
+      }
+      UpdateHistogram();
+      break;
+    }
     default: {
+      return;
     }
   }
+  dirty_ = true;
+}
+
+void ProblemVisualization::UpdateHistogram() {
+  LandingHeatmap::Grid counts = current_landings_;
+  if (heatmap_ != nullptr && histogram_view_ == HistogramView::kRecent) {
+    counts = heatmap_->Decayed(kRecentLandingsDecay);
+  } else if (heatmap_ != nullptr && histogram_view_ == HistogramView::kAllTime) {
+    counts = heatmap_->AllTime();
+  }
+  // nothing may have landed on the grid yet
+  const float max_count = std::max(counts.maxCoeff(), 1.F);
+
+  constexpr int kCells = LandingHeatmap::kCells;
+  Eigen::Matrix<std::pair<float, glm::vec3>, kCells, kCells> histogram;
+  const float max_z = -2.F;
+  const float min_z = -1.F;
+  const glm::vec3 warm = {0.5, 0.7, 0};
+  const glm::vec3 cold = {0, 0.4, 1};
+  for (int kx = 0; kx < kCells; kx++) {
+    for (int ky = 0; ky < kCells; ky++) {
+      const float z = counts(kx, ky) / max_count;
+      const glm::vec3 col = z * warm + (1 - z) * cold;
+      histogram(kx, ky) = std::make_pair(min_z + z * (max_z - min_z), col);
+    }
+  }
+  // the range is given by the centers of the first and last cells
+  const double half_cell = LandingHeatmap::kHalfWidth / kCells;
+  histogram_vis_.Update(histogram, static_cast<float>(LandingHeatmap::MinX() + half_cell),
+                        static_cast<float>(LandingHeatmap::MaxX() - half_cell),
+                        static_cast<float>(LandingHeatmap::MinY() + half_cell),
+                        static_cast<float>(LandingHeatmap::MaxY() - half_cell));
 }
 
 Eigen::Matrix<glm::vec3, 2, 2> ProblemVisualization::CourtCorners() {
@@ -165,3 +229,18 @@ Eigen::Matrix<glm::vec3, 2, 2> ProblemVisualization::CourtCorners() {
 
   return court;
 }
+
+std::vector<bb3d::ColoredVec3> ProblemVisualization::DrawPath(const std::vector<glm::dvec3> &path,
+                                                              const glm::vec4 &color) {
+  std::vector<bb3d::ColoredVec3> ret;
+  ret.reserve(path.size());
+  for (const glm::dvec3 &point : path) {
+    bb3d::ColoredVec3 v{};
+    v.position.x = static_cast<float>(point.x);
+    v.position.y = static_cast<float>(point.y);
+    v.position.z = static_cast<float>(point.z);
+    v.color = color;
+    ret.push_back(v);
+  }
+  return ret;
+}
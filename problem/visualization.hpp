@@ -1,22 +1,24 @@
 #pragma once
 
-#include <algorithm>           // for max, min
+#include <cmath>               // for sqrt
+#include <cstddef>             // for size_t
 #include <eigen3/Eigen/Dense>  // for Matrix, DenseCoeffsBase, DenseBase<>::ConstantReturnType
 #include <glm/glm.hpp>         // for vec3, dvec3, operator*, vec, vec<>::(anonymous), operator+
 #include <memory>              // for allocator_traits<>::value_type
-#include <utility>             // for pair, make_pair
 #include <vector>              // for vector
 
-#include "bb3d/assert.hpp"             // for ASSERT
-#include "bb3d/shader/colorlines.hpp"  // for ColoredVec3, ColorLines
-#include "bb3d/shader/cubemesh.hpp"    // for Cubemesh
-#include "bb3d/shader/gridmesh.hpp"    // for Gridmesh
-#include "bb3d/shader/lines.hpp"       // for Lines
-#include "bspline.hpp"                 // for Surface
-#include "problem/backboard.hpp"       // for Backboard
-#include "problem/hoop.hpp"            // for Hoop, Hoop::kRimDiameter
-#include "problem/problem.hpp"         // for Problem
-#include "problem/shot.hpp"            // for Bounce, Sample, Shot
+#include "bb3d/shader/colorlines.hpp"   // for ColoredVec3, ColorLines
+#include "bb3d/shader/cubemesh.hpp"     // for Cubemesh
+#include "bb3d/shader/gridmesh.hpp"     // for Gridmesh
+#include "bb3d/shader/lines.hpp"        // for Lines
+#include "bspline.hpp"                  // for Surface
+#include "problem/aero.hpp"             // for AeroParameters
+#include "problem/backboard.hpp"        // for Backboard
+#include "problem/hoop.hpp"             // for Hoop, Hoop::kRimDiameter
+#include "problem/landing_heatmap.hpp"  // for LandingHeatmap
+#include "problem/problem.hpp"          // for Problem
+#include "problem/shot.hpp"             // for Bounce, Sample, Shot
+#include "problem/shot_set.hpp"         // for ShotSet
 
 template <typename T>
 std::vector<std::vector<T> > SingletonVector(std::vector<T> xs) {
@@ -32,31 +34,33 @@ class ProblemVisualization {
   void Draw(const glm::mat4 &view, const glm::mat4 &proj);
 
   template <int NU_OBJ, int NV_OBJ, int NU_VIS, int NV_VIS, int NX, int NY>
-  void Update(const Eigen::Matrix<glm::dvec3, NX, NY> &control_points) {
+  void Update(const Eigen::Matrix<glm::dvec3, NX, NY> &control_points, const ShotSet &shot_set) {
     // shot and bounce lines
     const std::vector<Sample> samples =
-        Problem<NX, NY>::template ComputeShots<NU_OBJ, NV_OBJ>(control_points);
+        Problem<NX, NY>::template ComputeShots<NU_OBJ, NV_OBJ>(control_points, shot_set);
+    // where each sample lands, and with drag how it gets there
+    std::vector<glm::dvec3> landing_points;
+    std::vector<std::vector<glm::dvec3> > aero_paths;
+    if (aero_ != nullptr) {
+      landing_points = Problem<NX, NY>::template ComputeAeroLandings<NU_OBJ, NV_OBJ>(
+          control_points, shot_set, *aero_, &aero_paths);
+    } else {
+      for (const Sample &sample : samples) {
+        landing_points.push_back(sample.bounce_.landing_point_);
+      }
+    }
 
     // shots
     // ------------------------------------------------------
     std::vector<std::vector<bb3d::ColoredVec3> > shot_lines;
     std::vector<std::vector<bb3d::ColoredVec3> > bounce_lines;
-    // histogram range
-    auto min_x = static_cast<float>(samples[0].bounce_.landing_point_.x);
-    auto max_x = static_cast<float>(samples[0].bounce_.landing_point_.x);
-    auto min_y = static_cast<float>(samples[0].bounce_.landing_point_.y);
-    auto max_y = static_cast<float>(samples[0].bounce_.landing_point_.y);
-    for (const Sample &sample : samples) {
-      const Shot &shot = sample.shot_;
-      const Bounce &bounce = sample.bounce_;
-
-      min_x = std::min(min_x, static_cast<float>(bounce.landing_point_.x));
-      max_x = std::max(max_x, static_cast<float>(bounce.landing_point_.x));
-      min_y = std::min(min_y, static_cast<float>(bounce.landing_point_.y));
-      max_y = std::max(max_y, static_cast<float>(bounce.landing_point_.y));
+    for (size_t k = 0; k < samples.size(); k++) {
+      const Shot &shot = samples[k].shot_;
+      const Bounce &bounce = samples[k].bounce_;
 
       // Color shot by how close it is to going in.
-      double dist = bounce.XYDistanceFromHoop();
+      const glm::dvec3 miss = landing_points[k] - Hoop::RimCenter();
+      double dist = std::sqrt(miss.x * miss.x + miss.y * miss.y);
       auto r = static_cast<float>(dist / Hoop::kRimDiameter);
       if (r < 0) {
         r = 0;
@@ -68,44 +72,24 @@ class ProblemVisualization {
       glm::vec4 bounce_color = {r, g, 0, 0.6};
       glm::vec4 shot_color = {r, g, 0, 0.4};
       const std::vector<bb3d::ColoredVec3> shot_arc = shot.DrawArc(shot_color);
-      const std::vector<bb3d::ColoredVec3> bounce_arc = bounce.DrawArc(bounce_color);
+      const std::vector<bb3d::ColoredVec3> bounce_arc =
+          aero_ != nullptr ? DrawPath(aero_paths[k], bounce_color) : bounce.DrawArc(bounce_color);
       shot_lines.push_back(shot_arc);
       bounce_lines.push_back(bounce_arc);
     }
     shot_lines_vis_.Update(shot_lines);
     bounce_lines_vis_.Update(bounce_lines);
 
-    // histogram
-    constexpr int nx_hist = 24;
-    constexpr int ny_hist = 24;
-    Eigen::Matrix<int, nx_hist, ny_hist> histogram = Eigen::Matrix<int, nx_hist, ny_hist>::Zero();
-    int max_count = 0;
-    for (const Sample &sample : samples) {
-      const glm::vec3 &landing_point = sample.bounce_.landing_point_;
-      int kx =
-          static_cast<int>(0.5 + float(nx_hist - 1) * (landing_point.x - min_x) / (max_x - min_x));
-      int ky =
-          static_cast<int>(0.5 + float(ny_hist - 1) * (landing_point.y - min_y) / (max_y - min_y));
-      ASSERT(kx >= 0);
-      ASSERT(kx < nx_hist);
-      ASSERT(ky >= 0);
-      ASSERT(ky < ny_hist);
-      histogram(kx, ky)++;
-      max_count = std::max(max_count, histogram(kx, ky));
-    }
-    Eigen::Matrix<std::pair<float, glm::vec3>, nx_hist, ny_hist> histogram_float;
-    const float max_z = -2.F;
-    const float min_z = -1.F;
-    const glm::vec3 warm = {0.5, 0.7, 0};
-    const glm::vec3 cold = {0, 0.4, 1};
-    for (int kx = 0; kx < nx_hist; kx++) {
-      for (int ky = 0; ky < ny_hist; ky++) {
-        const float z = static_cast<float>(histogram(kx, ky)) / static_cast<float>(max_count);
-        const glm::vec3 col = z * warm + (1 - z) * cold;
-        histogram_float(kx, ky) = std::make_pair(min_z + z * (max_z - min_z), col);
+    // histogram of this design's landings, on the same grid as the long-run heatmap
+    current_landings_ = LandingHeatmap::Grid::Zero();
+    for (const glm::dvec3 &landing_point : landing_points) {
+      int kx = 0;
+      int ky = 0;
+      if (LandingHeatmap::Cell(landing_point, &kx, &ky)) {
+        current_landings_(kx, ky) += 1;
       }
     }
-    histogram_vis_.Update(histogram_float, min_x, max_x, min_y, max_y);
+    UpdateHistogram();
 
     // Rim
     rim_vis_.Update(SingletonVector(Hoop::DrawArc()));
@@ -146,12 +130,33 @@ class ProblemVisualization {
       }
     }
     control_points_vis_.Update(SingletonVector(control_point_vec));
+    dirty_ = true;
   }
 
   void HandleKeyPress(int key);
 
+  // Landings accumulated over the run, for the long-run histogram views. They're only those of the
+  // drawn shots, not the whole shot set. Must outlive this.
+  void SetLandingHeatmap(const LandingHeatmap *heatmap) { heatmap_ = heatmap; }
+
+  // Fly the ball off the backboard with drag and Magnus forces, like AeroObjectiveFunction, instead
+  // of drag-free. Takes effect at the next Update. Must outlive this.
+  void SetAero(const AeroParameters *aero) { aero_ = aero; }
+
+  // Whether anything drawn has changed since the last Draw.
+  [[nodiscard]] bool Dirty() const { return dirty_; }
+
  private:
+  enum class HistogramView {
+    kCurrent,  // the latest design
+    kRecent,   // the run so far, fading out older designs
+    kAllTime,  // the run so far
+  };
+
   static Eigen::Matrix<glm::vec3, 2, 2> CourtCorners();
+  static std::vector<bb3d::ColoredVec3> DrawPath(const std::vector<glm::dvec3> &path,
+                                                 const glm::vec4 &color);
+  void UpdateHistogram();
 
   bool shots_on_ = false;
   bool bounces_on_ = true;
@@ -161,6 +166,11 @@ class ProblemVisualization {
   bool control_points_on_ = true;
   bool histogram_on_ = true;
   bool wireframe_on_ = false;
+  bool dirty_ = true;
+  HistogramView histogram_view_ = HistogramView::kCurrent;
+  LandingHeatmap::Grid current_landings_ = LandingHeatmap::Grid::Zero();
+  const LandingHeatmap *heatmap_ = nullptr;
+  const AeroParameters *aero_ = nullptr;  // nullptr for drag-free flight
 
   bb3d::Gridmesh backboard_vis_;
   bb3d::Lines rim_vis_;
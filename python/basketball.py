@@ -0,0 +1,93 @@
+"""
+NumPy front end to the _basketball extension (python/basketball_module.cpp), for notebooks.
+
+  import basketball
+  position, tangent_u, tangent_v, normal = basketball.surface(control_points, params)
+  x, y, z = basketball.load_shot_set('/tmp/shots.bin')   # memory-mapped, no copies
+  objectives = basketball.objective(candidates, (x, y, z))
+  bounce_points, landing_points = basketball.shots(dvs, (x, y, z))
+
+Arrays that already have the right dtype and layout are used in place. Everything runs in C++
+without the GIL, on all cores unless threads says otherwise.
+
+Design variables are the backboard control point depths, NX x NY flattened row major as in vis.
+Shot points are float32 x, y, z arrays like a shot set file holds; an n x 3 array also works but
+is converted first. Shots are computed on the NU_OBJ x NV_OBJ bounce grid, minus its border.
+
+Design variables must be finite and within the optimizer's bounds, and shot points finite and
+below every bounce point (z is down). Anything else raises ValueError before any work is done.
+"""
+
+import struct
+
+import numpy as np
+
+import _basketball
+from _basketball import NX, NY, NU_OBJ, NV_OBJ, NUM_BOUNCE_POINTS
+
+SHOT_SET_MAGIC = b'BBSHOT01'
+SHOT_SET_HEADER_FORMAT = '<8s4Q'
+
+
+def surface(control_points, params, threads=0):
+  """
+  Clamped cubic B-spline surface through control_points (nx x ny x 3) at params (n x 2) in
+  [0, 1]. Returns position, tangent_u, tangent_v and normal, each n x 3.
+  """
+  control_points = np.ascontiguousarray(control_points, dtype=np.float64)
+  params = np.ascontiguousarray(params, dtype=np.float64).reshape(-1, 2)
+  n = params.shape[0]
+  position, tangent_u, tangent_v, normal = (np.empty((n, 3)) for _ in range(4))
+  _basketball.evaluate_surface(control_points, params, position, tangent_u, tangent_v, normal,
+                               threads=threads)
+  return position, tangent_u, tangent_v, normal
+
+
+def surface_grid(control_points, us, vs, threads=0):
+  """Surface positions on the grid us x vs, len(vs) x len(us) x 3."""
+  u_grid, v_grid = np.meshgrid(us, vs)
+  params = np.stack([u_grid.ravel(), v_grid.ravel()], axis=1)
+  position = np.empty((params.shape[0], 3))
+  _basketball.evaluate_surface(np.ascontiguousarray(control_points, dtype=np.float64),
+                               params, position, threads=threads)
+  return position.reshape(len(vs), len(us), 3)
+
+
+def load_shot_set(path):
+  """x, y, z arrays memory-mapped straight from a shot set file (see problem/shot_set.hpp)."""
+  with open(path, 'rb') as f:
+    header = f.read(struct.calcsize(SHOT_SET_HEADER_FORMAT))
+  magic, count, x_offset, y_offset, z_offset = struct.unpack(SHOT_SET_HEADER_FORMAT, header)
+  if magic != SHOT_SET_MAGIC:
+    raise ValueError('%s is not a shot set file' % path)
+  return tuple(np.memmap(path, dtype=np.float32, mode='r', offset=offset, shape=(count,))
+               for offset in (x_offset, y_offset, z_offset))
+
+
+def _shot_arrays(shot_points):
+  if isinstance(shot_points, tuple):
+    return tuple(np.ascontiguousarray(a, dtype=np.float32) for a in shot_points)
+  shot_points = np.asarray(shot_points, dtype=np.float32).reshape(-1, 3)
+  return tuple(np.ascontiguousarray(shot_points[:, k]) for k in range(3))
+
+
+def objective(dvs, shot_points, aero=False, threads=0):
+  """Objective of each candidate, a row of dvs (m x NX*NY), over the shot points. Returns m."""
+  dvs = np.ascontiguousarray(dvs, dtype=np.float64).reshape(-1, NX * NY)
+  x, y, z = _shot_arrays(shot_points)
+  out = np.empty(dvs.shape[0])
+  _basketball.objective(dvs, x, y, z, out, aero=aero, threads=threads)
+  return out
+
+
+def shots(dvs, shot_points, threads=0):
+  """
+  Bounce and landing points of every shot off one backboard, each n x NUM_BOUNCE_POINTS x 3 with
+  the bounce points in the same order as vis.
+  """
+  dvs = np.ascontiguousarray(dvs, dtype=np.float64).reshape(NX * NY)
+  x, y, z = _shot_arrays(shot_points)
+  bounce_points = np.empty((x.shape[0], NUM_BOUNCE_POINTS, 3))
+  landing_points = np.empty((x.shape[0], NUM_BOUNCE_POINTS, 3))
+  _basketball.compute_shots(dvs, x, y, z, bounce_points, landing_points, threads=threads)
+  return bounce_points, landing_points
@@ -0,0 +1,421 @@
+// Python extension exposing the spline, shot and objective code to NumPy, see python/basketball.py.
+//
+// Every argument is taken through the buffer protocol, so NumPy arrays (or anything else
+// exporting a C-contiguous buffer of the right type) are read and written in place without
+// copies. Outputs are preallocated by the caller. The GIL is released while computing, and batches
+// are split across threads.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <algorithm>           // for max, min
+#include <array>               // for array
+#include <cmath>               // for isfinite
+#include <cstdio>              // for snprintf
+#include <cstring>             // for strcmp
+#include <eigen3/Eigen/Dense>  // for Matrix, Dynamic
+#include <exception>           // for exception
+#include <functional>          // for function
+#include <glm/glm.hpp>         // for dvec3
+#include <initializer_list>    // for initializer_list
+#include <stdexcept>           // for out_of_range
+#include <string>              // for string
+#include <vector>              // for vector
+
+#include "bspline.hpp"            // for CubicBSplinePoint, PadSurface, Surface, SurfacePoint
+#include "problem/aero.hpp"       // for AeroParameters
+#include "problem/backboard.hpp"  // for Backboard
+#include "problem/config.hpp"     // for NX, NY, NU_OBJ, NV_OBJ, Vec2Dvs, DvsValid
+#include "problem/parallel.hpp"   // for NumThreads, ParallelFor
+#include "problem/problem.hpp"    // for Problem
+#include "problem/shot.hpp"       // for Sample
+#include "problem/shot_set.hpp"   // for ShotSet
+
+namespace {
+
+constexpr int kNumBouncePoints = (NU_OBJ - 2) * (NV_OBJ - 2);
+
+// A C-contiguous buffer borrowed from a Python object for the duration of a call.
+class Buffer {
+ public:
+  Buffer() = default;
+  ~Buffer() {
+    if (view_.obj != nullptr) {
+      PyBuffer_Release(&view_);
+    }
+  }
+  Buffer(const Buffer &) = delete;
+  Buffer &operator=(const Buffer &) = delete;
+
+  // Borrow obj's buffer and check it holds doubles ('d') or floats ('f') in the given shape,
+  // where -1 matches any size. Returns false with a Python exception set otherwise.
+  bool Get(PyObject *obj, const char *name, const char format, const bool writable,
+           const std::initializer_list<Py_ssize_t> shape) {
+    const int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | (writable ? PyBUF_WRITABLE : 0);
+    if (PyObject_GetBuffer(obj, &view_, flags) != 0) {
+      PyErr_Format(PyExc_TypeError, "%s must be a C-contiguous%s buffer", name,
+                   writable ? " writable" : "");
+      return false;
+    }
+    // Accept native or little-endian standard sizes, which is the same thing everywhere we run.
+    const char *f = view_.format;
+    if (f[0] == '@' || f[0] == '=' || f[0] == '<') {
+      f++;  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    }
+    if (f[0] != format || f[1] != '\0') {
+      PyErr_Format(PyExc_TypeError, "%s must hold %s", name,
+                   format == 'd' ? "float64" : "float32");
+      return false;
+    }
+    if (view_.ndim != static_cast<int>(shape.size())) {
+      PyErr_Format(PyExc_ValueError, "%s must have %d dimensions, not %d", name,
+                   static_cast<int>(shape.size()), view_.ndim);
+      return false;
+    }
+    int k = 0;
+    for (const Py_ssize_t expected : shape) {
+      if (expected >= 0 && view_.shape[k] != expected) {  // NOLINT
+        PyErr_Format(PyExc_ValueError, "%s has size %zd along axis %d, expected %zd", name,
+                     view_.shape[k], k, expected);  // NOLINT
+        return false;
+      }
+      k++;
+    }
+    return true;
+  }
+
+  [[nodiscard]] bool Empty() const { return view_.obj == nullptr; }
+  [[nodiscard]] Py_ssize_t Shape(const int axis) const {
+    return view_.shape[axis];  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  }
+  [[nodiscard]] size_t Size() const { return static_cast<size_t>(view_.len / view_.itemsize); }
+  template <typename T>
+  [[nodiscard]] T *Data() const {
+    return static_cast<T *>(view_.buf);
+  }
+
+ private:
+  Py_buffer view_{};
+};
+
+bool OptionalBuffer(Buffer &buffer, PyObject *obj, const char *name, const Py_ssize_t n) {
+  return obj == nullptr || obj == Py_None || buffer.Get(obj, name, 'd', true, {n, 3});
+}
+
+// Run f without the GIL and turn C++ exceptions into Python ones.
+PyObject *Compute(const std::function<void()> &f) {
+  const char *error = nullptr;
+  std::string what;
+  Py_BEGIN_ALLOW_THREADS;
+  try {
+    f();
+  } catch (const std::exception &e) {
+    what = e.what();
+    error = what.c_str();
+  }
+  Py_END_ALLOW_THREADS;
+  if (error != nullptr) {
+    PyErr_SetString(PyExc_RuntimeError, error);
+    return nullptr;
+  }
+  Py_RETURN_NONE;
+}
+
+bool GetShotPoints(PyObject *x_obj, PyObject *y_obj, PyObject *z_obj, Buffer &x, Buffer &y,
+                   Buffer &z) {
+  if (!x.Get(x_obj, "x", 'f', false, {-1})) {
+    return false;
+  }
+  return y.Get(y_obj, "y", 'f', false, {x.Shape(0)}) && z.Get(z_obj, "z", 'f', false, {x.Shape(0)});
+}
+
+// The shot and objective code ASSERTs on input it can't handle, which would take the interpreter
+// down with it, so arguments are checked up front and raise ValueError instead. These need the GIL.
+bool CheckDvs(const Buffer &dvs, const Py_ssize_t rows) {
+  for (Py_ssize_t k = 0; k < rows; k++) {
+    if (!DvsValid(&dvs.Data<const double>()[k * NX * NY])) {
+      // PyErr_Format has no %g
+      std::array<char, 128> message{};
+      snprintf(message.data(), message.size(),
+               "design variables of candidate %zd must be finite and in [%g, %g]", k,
+               kDvLowerBound, kDvUpperBound);
+      PyErr_SetString(PyExc_ValueError, message.data());
+      return false;
+    }
+  }
+  return true;
+}
+
+// Shots are taken from below every bounce point (z is down), as Shot assumes.
+bool CheckShotPoints(const Buffer &x, const Buffer &y, const Buffer &z) {
+  static const double max_bounce_z = Problem<NX, NY>::MaxBounceZ<NU_OBJ, NV_OBJ>();
+  const float *xs = x.Data<const float>();
+  const float *ys = y.Data<const float>();
+  const float *zs = z.Data<const float>();
+  for (Py_ssize_t k = 0; k < x.Shape(0); k++) {
+    if (!std::isfinite(xs[k]) || !std::isfinite(ys[k]) || !(zs[k] > max_bounce_z)) {  // NOLINT
+      std::array<char, 128> message{};
+      snprintf(message.data(), message.size(),
+               "shot point %zd must be finite and below every bounce point (z > %g)", k,
+               max_bounce_z);
+      PyErr_SetString(PyExc_ValueError, message.data());
+      return false;
+    }
+  }
+  return true;
+}
+
+Eigen::Matrix<glm::dvec3, NX, NY> ControlPoints(const double *dvs) {
+  return Backboard<NX, NY>::ToControlPoints(Vec2Dvs(dvs));
+}
+
+PyObject *EvaluateSurface(PyObject * /*self*/, PyObject *args, PyObject *kwargs) {
+  static const char *keywords[] = {"control_points", "params",    "position", "tangent_u",
+                                   "tangent_v",      "normal",    "threads",  nullptr};
+  PyObject *control_points_obj{};
+  PyObject *params_obj{};
+  PyObject *position_obj{};
+  PyObject *tangent_u_obj = nullptr;
+  PyObject *tangent_v_obj = nullptr;
+  PyObject *normal_obj = nullptr;
+  int threads = 0;
+  if (PyArg_ParseTupleAndKeywords(args, kwargs, "OOO|OOOi", const_cast<char **>(keywords),
+                                  &control_points_obj, &params_obj, &position_obj,
+                                  &tangent_u_obj, &tangent_v_obj, &normal_obj, &threads) == 0) {
+    return nullptr;
+  }
+
+  Buffer control_points;
+  Buffer params;
+  Buffer position;
+  Buffer tangent_u;
+  Buffer tangent_v;
+  Buffer normal;
+  if (!control_points.Get(control_points_obj, "control_points", 'd', false, {-1, -1, 3}) ||
+      !params.Get(params_obj, "params", 'd', false, {-1, 2})) {
+    return nullptr;
+  }
+  const Py_ssize_t n = params.Shape(0);
+  if (!position.Get(position_obj, "position", 'd', true, {n, 3}) ||
+      !OptionalBuffer(tangent_u, tangent_u_obj, "tangent_u", n) ||
+      !OptionalBuffer(tangent_v, tangent_v_obj, "tangent_v", n) ||
+      !OptionalBuffer(normal, normal_obj, "normal", n)) {
+    return nullptr;
+  }
+  const auto nx = static_cast<int>(control_points.Shape(0));
+  const auto ny = static_cast<int>(control_points.Shape(1));
+  if (nx < 1 || ny < 1) {
+    PyErr_SetString(PyExc_ValueError, "control_points must not be empty");
+    return nullptr;
+  }
+
+  return Compute([&]() {
+    Eigen::Matrix<glm::dvec3, Eigen::Dynamic, Eigen::Dynamic> ps(nx, ny);
+    const auto *cp = control_points.Data<const double>();
+    for (int kx = 0; kx < nx; kx++) {
+      for (int ky = 0; ky < ny; ky++) {
+        const double *p = &cp[3 * (kx * ny + ky)];
+        ps(kx, ky) = glm::dvec3(p[0], p[1], p[2]);  // NOLINT
+      }
+    }
+    const Eigen::Matrix<glm::dvec3, Eigen::Dynamic, Eigen::Dynamic> clamped_ps = PadSurface(ps);
+
+    const auto *st = params.Data<const double>();
+    auto store = [](const Buffer &buffer, const size_t k, const glm::dvec3 &v) {
+      if (!buffer.Empty()) {
+        double *out = &buffer.Data<double>()[3 * k];
+        out[0] = v.x;  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        out[1] = v.y;  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        out[2] = v.z;  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      }
+    };
+    constexpr size_t kChunk = 4096;
+    const auto num_points = static_cast<size_t>(n);
+    ParallelFor((num_points + kChunk - 1) / kChunk, NumThreads(threads), [&](const size_t chunk) {
+      for (size_t k = chunk * kChunk; k < std::min(num_points, (chunk + 1) * kChunk); k++) {
+        const double s = st[2 * k];
+        const double t = st[2 * k + 1];
+        if (!(s >= 0 && s <= 1 && t >= 0 && t <= 1)) {
+          throw std::out_of_range("surface parameters must be in [0, 1]");
+        }
+        const SurfacePoint point = CubicBSplinePoint(clamped_ps, s, t);
+        store(position, k, point.position);
+        store(tangent_u, k, point.tangent_u);
+        store(tangent_v, k, point.tangent_v);
+        store(normal, k, point.normal);
+      }
+    });
+  });
+}
+
+PyObject *ComputeShots(PyObject * /*self*/, PyObject *args, PyObject *kwargs) {
+  static const char *keywords[] = {"dvs", "x", "y", "z", "bounce_points", "landing_points",
+                                   "threads", nullptr};
+  PyObject *dvs_obj{};
+  PyObject *x_obj{};
+  PyObject *y_obj{};
+  PyObject *z_obj{};
+  PyObject *bounce_points_obj{};
+  PyObject *landing_points_obj{};
+  int threads = 0;
+  if (PyArg_ParseTupleAndKeywords(args, kwargs, "OOOOOO|i", const_cast<char **>(keywords),
+                                  &dvs_obj, &x_obj, &y_obj, &z_obj, &bounce_points_obj,
+                                  &landing_points_obj, &threads) == 0) {
+    return nullptr;
+  }
+
+  Buffer dvs;
+  Buffer x;
+  Buffer y;
+  Buffer z;
+  Buffer bounce_points;
+  Buffer landing_points;
+  if (!dvs.Get(dvs_obj, "dvs", 'd', false, {NX * NY}) ||
+      !GetShotPoints(x_obj, y_obj, z_obj, x, y, z) || !CheckDvs(dvs, 1) ||
+      !CheckShotPoints(x, y, z)) {
+    return nullptr;
+  }
+  const Py_ssize_t n = x.Shape(0);
+  if (!bounce_points.Get(bounce_points_obj, "bounce_points", 'd', true,
+                         {n, kNumBouncePoints, 3}) ||
+      !landing_points.Get(landing_points_obj, "landing_points", 'd', true,
+                          {n, kNumBouncePoints, 3})) {
+    return nullptr;
+  }
+
+  return Compute([&]() {
+    const Eigen::Matrix<glm::dvec3, NX, NY> control_points = ControlPoints(dvs.Data<double>());
+    constexpr size_t kChunk = 256;
+    const auto num_shots = static_cast<size_t>(n);
+    ParallelFor((num_shots + kChunk - 1) / kChunk, NumThreads(threads), [&](const size_t chunk) {
+      const size_t begin = chunk * kChunk;
+      const size_t size = std::min(num_shots - begin, kChunk);
+      const ShotSet shot_set = ShotSet::View(&x.Data<const float>()[begin],
+                                             &y.Data<const float>()[begin],
+                                             &z.Data<const float>()[begin], size);
+      const std::vector<Sample> samples =
+          Problem<NX, NY>::ComputeShots<NU_OBJ, NV_OBJ>(control_points, shot_set);
+      double *bounce = &bounce_points.Data<double>()[3 * kNumBouncePoints * begin];
+      double *landing = &landing_points.Data<double>()[3 * kNumBouncePoints * begin];
+      for (size_t k = 0; k < samples.size(); k++) {
+        const glm::dvec3 &b = samples[k].bounce_.bounce_point_;
+        const glm::dvec3 &l = samples[k].bounce_.landing_point_;
+        bounce[3 * k] = b.x;       // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        bounce[3 * k + 1] = b.y;   // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        bounce[3 * k + 2] = b.z;   // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        landing[3 * k] = l.x;      // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        landing[3 * k + 1] = l.y;  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        landing[3 * k + 2] = l.z;  // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      }
+    });
+  });
+}
+
+PyObject *Objective(PyObject * /*self*/, PyObject *args, PyObject *kwargs) {
+  static const char *keywords[] = {"dvs", "x", "y", "z", "out", "aero", "threads", nullptr};
+  PyObject *dvs_obj{};
+  PyObject *x_obj{};
+  PyObject *y_obj{};
+  PyObject *z_obj{};
+  PyObject *out_obj{};
+  int aero = 0;
+  int threads = 0;
+  if (PyArg_ParseTupleAndKeywords(args, kwargs, "OOOOO|pi", const_cast<char **>(keywords),
+                                  &dvs_obj, &x_obj, &y_obj, &z_obj, &out_obj, &aero,
+                                  &threads) == 0) {
+    return nullptr;
+  }
+
+  Buffer dvs;
+  Buffer x;
+  Buffer y;
+  Buffer z;
+  Buffer out;
+  if (!dvs.Get(dvs_obj, "dvs", 'd', false, {-1, NX * NY}) ||
+      !GetShotPoints(x_obj, y_obj, z_obj, x, y, z) ||
+      !out.Get(out_obj, "out", 'd', true, {dvs.Shape(0)}) || !CheckDvs(dvs, dvs.Shape(0)) ||
+      !CheckShotPoints(x, y, z)) {
+    return nullptr;
+  }
+
+  return Compute([&]() {
+    const auto num_candidates = static_cast<size_t>(dvs.Shape(0));
+    const auto num_shots = static_cast<size_t>(x.Shape(0));
+    const int num_threads = NumThreads(threads);
+    // Split each candidate's shots too when there are fewer candidates than threads.
+    const size_t threads_per_candidate =
+        static_cast<size_t>(num_threads) / std::max<size_t>(1, num_candidates);
+    const size_t chunks = std::max<size_t>(1, std::min(num_shots, threads_per_candidate));
+    const size_t chunk_size = (num_shots + chunks - 1) / std::max<size_t>(1, chunks);
+    const AeroParameters aero_parameters;
+    std::vector<double> partial(num_candidates * chunks, 0);
+    ParallelFor(partial.size(), num_threads, [&](const size_t task) {
+      const size_t candidate = task / chunks;
+      const size_t begin = std::min(num_shots, (task % chunks) * chunk_size);
+      const size_t size = std::min(num_shots - begin, chunk_size);
+      const ShotSet shot_set = ShotSet::View(&x.Data<const float>()[begin],
+                                             &y.Data<const float>()[begin],
+                                             &z.Data<const float>()[begin], size);
+      const Eigen::Matrix<glm::dvec3, NX, NY> control_points =
+          ControlPoints(&dvs.Data<const double>()[candidate * NX * NY]);
+      partial[task] = aero != 0 ? Problem<NX, NY>::AeroObjectiveFunction<NU_OBJ, NV_OBJ>(
+                                      control_points, shot_set, aero_parameters)
+                                : Problem<NX, NY>::ObjectiveFunction<NU_OBJ, NV_OBJ>(
+                                      control_points, shot_set);
+    });
+    for (size_t candidate = 0; candidate < num_candidates; candidate++) {
+      double sum = 0;
+      for (size_t chunk = 0; chunk < chunks; chunk++) {
+        sum += partial[candidate * chunks + chunk];
+      }
+      out.Data<double>()[candidate] = sum;  // NOLINT
+    }
+  });
+}
+
+// Keyword methods are called with three arguments but registered as PyCFunction.
+PyCFunction Method(PyObject *(*f)(PyObject *, PyObject *, PyObject *)) {
+  return reinterpret_cast<PyCFunction>(reinterpret_cast<void (*)()>(f));
+}
+
+// NOLINTNEXTLINE(cppcoreguidelines-avoid-c-arrays)
+PyMethodDef kMethods[] = {
+    {"evaluate_surface", Method(EvaluateSurface),
+     METH_VARARGS | METH_KEYWORDS,
+     "evaluate_surface(control_points, params, position, tangent_u=None, tangent_v=None, "
+     "normal=None, threads=0)\n\n"
+     "Clamped cubic B-spline surface through control_points (nx, ny, 3) at params (n, 2) in "
+     "[0, 1], written into the (n, 3) outputs."},
+    {"compute_shots", Method(ComputeShots),
+     METH_VARARGS | METH_KEYWORDS,
+     "compute_shots(dvs, x, y, z, bounce_points, landing_points, threads=0)\n\n"
+     "Bounce and landing points (n, NUM_BOUNCE_POINTS, 3) of every shot from float32 shot points "
+     "x, y, z (n,) off the backboard with design variables dvs (NX * NY,)."},
+    {"objective", Method(Objective),
+     METH_VARARGS | METH_KEYWORDS,
+     "objective(dvs, x, y, z, out, aero=False, threads=0)\n\n"
+     "Objective of each row of dvs (m, NX * NY) over float32 shot points x, y, z (n,), written "
+     "into out (m,)."},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+PyModuleDef kModule = {
+    PyModuleDef_HEAD_INIT, "_basketball", "Batch spline, shot and objective evaluation.", -1,
+    kMethods,              nullptr,       nullptr,                                        nullptr,
+    nullptr,
+};
+
+}  // namespace
+
+PyMODINIT_FUNC PyInit__basketball() {
+  PyObject *module = PyModule_Create(&kModule);
+  if (module == nullptr) {
+    return nullptr;
+  }
+  PyModule_AddIntConstant(module, "NX", NX);
+  PyModule_AddIntConstant(module, "NY", NY);
+  PyModule_AddIntConstant(module, "NU_OBJ", NU_OBJ);
+  PyModule_AddIntConstant(module, "NV_OBJ", NV_OBJ);
+  PyModule_AddIntConstant(module, "NUM_BOUNCE_POINTS", kNumBouncePoints);
+  return module;
+}
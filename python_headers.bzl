@@ -0,0 +1,28 @@
+# Python headers for building C extensions, from the python3 on the PATH.
+
+def _python_headers_impl(repository_ctx):
+    python = repository_ctx.which("python3")
+    if python == None:
+        fail("python3 isn't on the PATH")
+    result = repository_ctx.execute([
+        python,
+        "-c",
+        "import sysconfig; print(sysconfig.get_paths()['include'])",
+    ])
+    if result.return_code != 0:
+        fail("can't find the Python headers: " + result.stderr)
+    repository_ctx.symlink(result.stdout.strip(), "include")
+    repository_ctx.file("BUILD.bazel", """
+cc_library(
+    name = "python_headers",
+    hdrs = glob(["include/**/*.h"]),
+    includes = ["include"],
+    visibility = ["//visibility:public"],
+)
+""")
+
+python_headers = repository_rule(
+    implementation = _python_headers_impl,
+    environ = ["PATH"],
+    local = True,
+)
@@ -0,0 +1,135 @@
+#include "render/frame_encoder.hpp"
+
+#include <png.h>  // for png_image, png_image_write_to_file, PNG_FORMAT_RGBA, PNG_IMAGE_VERSION
+
+#include <stdexcept>  // for runtime_error
+#include <utility>    // for move
+
+#include "bb3d/assert.hpp"  // for ASSERT
+
+FrameEncoderPool::FrameEncoderPool(const Format format, std::string destination,
+                                   const int num_threads, const size_t max_queued)
+    : format_(format), destination_(std::move(destination)), max_queued_(max_queued) {
+  ASSERT(num_threads > 0);
+  ASSERT(max_queued > 0);
+  int num_workers = num_threads;
+  if (format_ == Format::kRawVideo) {
+    pipe_ = popen(destination_.c_str(), "w");
+    if (pipe_ == nullptr) {
+      throw std::runtime_error("can't run video encoder: " + destination_);
+    }
+    num_workers = 1;
+  }
+  for (int k = 0; k < num_workers; k++) {
+    workers_.emplace_back([this]() { Work(); });
+  }
+}
+
+FrameEncoderPool::~FrameEncoderPool() {
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  queue_changed_.notify_all();
+  for (std::thread &worker : workers_) {
+    worker.join();
+  }
+  if (pipe_ != nullptr) {
+    pclose(pipe_);
+  }
+}
+
+std::vector<uint8_t> FrameEncoderPool::AcquireBuffer(const size_t size) {
+  std::vector<uint8_t> buffer;
+  {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (!free_buffers_.empty()) {
+      buffer = std::move(free_buffers_.back());
+      free_buffers_.pop_back();
+    }
+  }
+  buffer.resize(size);
+  return buffer;
+}
+
+void FrameEncoderPool::Submit(Frame frame) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    queue_changed_.wait(lock, [this]() { return queue_.size() < max_queued_; });
+    queue_.push_back(std::move(frame));
+  }
+  queue_changed_.notify_all();
+}
+
+int FrameEncoderPool::FramesWritten() {
+  const std::lock_guard<std::mutex> lock(mutex_);
+  return frames_written_;
+}
+
+void FrameEncoderPool::Work() {
+  for (;;) {
+    Frame frame;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      queue_changed_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;  // stopping, and nothing left to do
+      }
+      frame = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    // Somebody might be waiting for room in the queue.
+    queue_changed_.notify_all();
+
+    const bool written = Encode(frame);
+
+    {
+      const std::lock_guard<std::mutex> lock(mutex_);
+      if (written) {
+        frames_written_++;
+      }
+      free_buffers_.push_back(std::move(frame.rgba));
+    }
+  }
+}
+
+bool FrameEncoderPool::Encode(const Frame &frame) {
+  const size_t row_bytes = 4 * static_cast<size_t>(frame.width);
+  ASSERT(frame.rgba.size() == row_bytes * static_cast<size_t>(frame.height));
+
+  switch (format_) {
+    case Format::kPng: {
+      char name[32];
+      snprintf(name, sizeof(name), "/frame_%06d.png", frame.index);
+      const std::string path = destination_ + name;
+
+      png_image image{};
+      image.version = PNG_IMAGE_VERSION;
+      image.width = static_cast<png_uint_32>(frame.width);
+      image.height = static_cast<png_uint_32>(frame.height);
+      image.format = PNG_FORMAT_RGBA;
+      // A negative stride tells libpng the rows are bottom-up, like OpenGL gives them to us.
+      const auto row_stride = -static_cast<png_int_32>(row_bytes);
+      if (png_image_write_to_file(&image, path.c_str(), 0, frame.rgba.data(), row_stride,
+                                  nullptr) == 0) {
+        fprintf(stderr, "failed writing %s: %s\n", path.c_str(), image.message);
+        png_image_free(&image);
+        return false;
+      }
+      png_image_free(&image);
+      return true;
+    }
+    case Format::kRawVideo: {
+      // Video encoders want the top row first.
+      for (int row = frame.height - 1; row >= 0; row--) {
+        const uint8_t *data = &frame.rgba[static_cast<size_t>(row) * row_bytes];
+        if (fwrite(data, 1, row_bytes, pipe_) != row_bytes) {
+          fprintf(stderr, "failed writing frame %d to video encoder\n", frame.index);
+          return false;
+        }
+      }
+      return true;
+    }
+  }
+  return false;
+}
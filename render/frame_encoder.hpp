@@ -0,0 +1,63 @@
+#pragma once
+
+#include <condition_variable>  // for condition_variable
+#include <cstddef>             // for size_t
+#include <cstdint>             // for uint8_t
+#include <cstdio>              // for FILE
+#include <deque>               // for deque
+#include <mutex>               // for mutex
+#include <string>              // for string
+#include <thread>              // for thread
+#include <vector>              // for vector
+
+// A frame as read back from OpenGL: tightly packed RGBA rows, bottom row first.
+struct Frame {
+  int index;
+  int width;
+  int height;
+  std::vector<uint8_t> rgba;
+};
+
+// Encodes frames on a pool of worker threads so that rendering never waits on compression.
+//
+// kPng writes destination/frame_NNNNNN.png with as many workers as asked for. kRawVideo pipes raw
+// top-down RGBA frames to the stdin of the shell command in destination (e.g. ffmpeg -f rawvideo)
+// and always uses one worker, since frames must arrive in order.
+class FrameEncoderPool {
+ public:
+  enum class Format { kPng, kRawVideo };
+
+  // Throws std::runtime_error if the pipe can't be opened.
+  FrameEncoderPool(Format format, std::string destination, int num_threads, size_t max_queued);
+  // Encodes everything still queued, then joins the workers.
+  ~FrameEncoderPool();
+  FrameEncoderPool(const FrameEncoderPool &) = delete;
+  FrameEncoderPool &operator=(const FrameEncoderPool &) = delete;
+
+  // A buffer to read the next frame into, recycled from frames already encoded when possible.
+  std::vector<uint8_t> AcquireBuffer(size_t size);
+  // Queue a frame. Only blocks if max_queued frames are already waiting (back pressure, so a slow
+  // disk can't eat all our memory).
+  void Submit(Frame frame);
+
+  // Frames encoded successfully so far; failed writes are logged and not counted.
+  [[nodiscard]] int FramesWritten();
+
+ private:
+  void Work();
+  // Returns false if the frame couldn't be written.
+  bool Encode(const Frame &frame);
+
+  Format format_;
+  std::string destination_;
+  size_t max_queued_;
+  FILE *pipe_ = nullptr;
+
+  std::mutex mutex_;
+  std::condition_variable queue_changed_;
+  std::deque<Frame> queue_;
+  std::vector<std::vector<uint8_t> > free_buffers_;
+  bool stopping_ = false;
+  int frames_written_ = 0;
+  std::vector<std::thread> workers_;
+};
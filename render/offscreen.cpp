@@ -0,0 +1,199 @@
+#include "render/offscreen.hpp"
+
+#include <EGL/eglext.h>  // for EGL_PLATFORM_SURFACELESS_MESA, PFNEGLGETPLATFORMDISPLAYEXTPROC
+
+#include <cstdint>    // for uint8_t
+#include <cstdio>     // for fprintf, stderr
+#include <cstring>    // for memcpy
+#include <stdexcept>  // for runtime_error
+#include <string>     // for string, to_string
+#include <utility>    // for move
+#include <vector>     // for vector
+
+#include "bb3d/assert.hpp"  // for ASSERT
+
+OffscreenRenderer::OffscreenRenderer(const int width, const int height, FrameEncoderPool &encoder)
+    : width_(width), height_(height), encoder_(encoder) {
+  ASSERT(width > 0);
+  ASSERT(height > 0);
+  // The destructor doesn't run if the constructor throws, so release whatever was created first.
+  try {
+    CreateContext();
+    CreateFramebuffer();
+  } catch (...) {
+    Destroy();
+    throw;
+  }
+}
+
+void OffscreenRenderer::CreateFramebuffer() {
+  // framebuffer
+  glGenFramebuffers(1, &framebuffer_);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+  glGenRenderbuffers(1, &color_renderbuffer_);
+  glBindRenderbuffer(GL_RENDERBUFFER, color_renderbuffer_);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width_, height_);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER,
+                            color_renderbuffer_);
+  glGenRenderbuffers(1, &depth_renderbuffer_);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth_renderbuffer_);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width_, height_);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER,
+                            depth_renderbuffer_);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    throw std::runtime_error("offscreen framebuffer is incomplete");
+  }
+
+  // readback ring
+  const auto frame_bytes = static_cast<GLsizeiptr>(4 * width_ * height_);
+  glGenBuffers(kNumPbos, pbos_.data());
+  for (const GLuint pbo : pbos_) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, frame_bytes, nullptr, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  fences_.fill(nullptr);
+  frame_indices_.fill(-1);
+
+  glViewport(0, 0, width_, height_);
+  glEnable(GL_DEPTH_TEST);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+OffscreenRenderer::~OffscreenRenderer() {
+  Flush();
+  Destroy();
+}
+
+void OffscreenRenderer::Destroy() {
+  // GL names are only nonzero once glewInit has loaded the entry points to delete them with.
+  if (pbos_.front() != 0) {
+    glDeleteBuffers(kNumPbos, pbos_.data());
+  }
+  if (depth_renderbuffer_ != 0) {
+    glDeleteRenderbuffers(1, &depth_renderbuffer_);
+  }
+  if (color_renderbuffer_ != 0) {
+    glDeleteRenderbuffers(1, &color_renderbuffer_);
+  }
+  if (framebuffer_ != 0) {
+    glDeleteFramebuffers(1, &framebuffer_);
+  }
+  if (context_ != EGL_NO_CONTEXT) {
+    eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display_, context_);
+  }
+  if (display_ != EGL_NO_DISPLAY) {
+    eglTerminate(display_);
+  }
+}
+
+void OffscreenRenderer::CreateContext() {
+  // Prefer a surfaceless display so we don't need a GPU, a window system, or even a pbuffer.
+  auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+      eglGetProcAddress("eglGetPlatformDisplayEXT"));
+  if (get_platform_display != nullptr) {
+    display_ = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+  }
+  if (display_ == EGL_NO_DISPLAY) {
+    display_ = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+  EGLint major{};
+  EGLint minor{};
+  if (display_ == EGL_NO_DISPLAY || eglInitialize(display_, &major, &minor) == EGL_FALSE) {
+    throw std::runtime_error("can't initialize an EGL display");
+  }
+
+  const std::array<EGLint, 5> config_attributes = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                                   EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_NONE};
+  EGLConfig config{};
+  EGLint num_configs{};
+  if (eglChooseConfig(display_, config_attributes.data(), &config, 1, &num_configs) == EGL_FALSE ||
+      num_configs < 1) {
+    throw std::runtime_error("no EGL config supports desktop OpenGL");
+  }
+  if (eglBindAPI(EGL_OPENGL_API) == EGL_FALSE) {
+    throw std::runtime_error("can't bind the OpenGL API to EGL");
+  }
+
+  const std::array<EGLint, 7> context_attributes = {EGL_CONTEXT_MAJOR_VERSION,
+                                                    3,
+                                                    EGL_CONTEXT_MINOR_VERSION,
+                                                    3,
+                                                    EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                                    EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                                    EGL_NONE};
+  context_ = eglCreateContext(display_, config, EGL_NO_CONTEXT, context_attributes.data());
+  if (context_ == EGL_NO_CONTEXT) {
+    throw std::runtime_error("can't create an OpenGL 3.3 core context with EGL");
+  }
+  // Surfaceless: everything goes to our own framebuffer.
+  if (eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, context_) == EGL_FALSE) {
+    throw std::runtime_error("EGL display doesn't support surfaceless contexts");
+  }
+
+  glewExperimental = GL_TRUE;
+  const GLenum glew_status = glewInit();
+  // GLEW built for GLX complains that there's no X display after it has loaded the core entry
+  // points, which are all we use.
+  if (glew_status != GLEW_OK && glew_status != GLEW_ERROR_NO_GLX_DISPLAY) {
+    throw std::runtime_error("glewInit failed with error " + std::to_string(glew_status));
+  }
+}
+
+void OffscreenRenderer::BeginFrame() {
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+  glViewport(0, 0, width_, height_);
+  glClearColor(0.2F, 0.3F, 0.3F, 1.0F);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void OffscreenRenderer::EndFrame() {
+  const int slot = next_frame_ % kNumPbos;
+  // This slot's previous frame is the oldest in flight; it must be out before we reuse the PBO.
+  Collect(slot);
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer_);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos_.at(static_cast<size_t>(slot)));
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  fences_.at(static_cast<size_t>(slot)) = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  frame_indices_.at(static_cast<size_t>(slot)) = next_frame_;
+  next_frame_++;
+  // Make sure the GPU starts on the readback now rather than whenever it next gets around to it.
+  glFlush();
+}
+
+void OffscreenRenderer::Flush() {
+  // oldest first
+  for (int k = 0; k < kNumPbos; k++) {
+    Collect((next_frame_ + k) % kNumPbos);
+  }
+}
+
+void OffscreenRenderer::Collect(const int slot) {
+  const auto s = static_cast<size_t>(slot);
+  if (frame_indices_.at(s) < 0) {
+    return;
+  }
+  glClientWaitSync(fences_.at(s), GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+  glDeleteSync(fences_.at(s));
+  fences_.at(s) = nullptr;
+
+  const size_t frame_bytes = 4 * static_cast<size_t>(width_) * static_cast<size_t>(height_);
+  std::vector<uint8_t> rgba = encoder_.AcquireBuffer(frame_bytes);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos_.at(s));
+  const void *mapped = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+  if (mapped != nullptr) {
+    memcpy(rgba.data(), mapped, frame_bytes);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    encoder_.Submit({frame_indices_.at(s), width_, height_, std::move(rgba)});
+  } else {
+    fprintf(stderr, "failed to map pixel buffer for frame %d\n", frame_indices_.at(s));
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  frame_indices_.at(s) = -1;
+}
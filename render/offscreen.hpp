@@ -0,0 +1,59 @@
+#pragma once
+
+#include <EGL/egl.h>  // for EGLDisplay, EGLContext
+#include <GL/glew.h>  // for GLuint, GLsync
+
+#include <array>  // for array
+
+#include "render/frame_encoder.hpp"  // for FrameEncoderPool
+
+// Headless rendering for render boxes without a display.
+//
+// Creates an OpenGL 3.3 core context on a surfaceless EGL display (Mesa's software rasterizer
+// works fine) and renders into an offscreen framebuffer. Frames are read back through a ring of
+// pixel buffer objects: glReadPixels into a PBO returns immediately and the pixels are only mapped
+// kNumPbos - 1 frames later, so rendering doesn't wait for the readback and the copy out is
+// handed straight to the encoder pool.
+class OffscreenRenderer {
+ public:
+  // Throws std::runtime_error if there's no usable EGL/OpenGL.
+  OffscreenRenderer(int width, int height, FrameEncoderPool &encoder);
+  ~OffscreenRenderer();
+  OffscreenRenderer(const OffscreenRenderer &) = delete;
+  OffscreenRenderer &operator=(const OffscreenRenderer &) = delete;
+
+  // Bind and clear the framebuffer. Draw after calling this.
+  void BeginFrame();
+  // Start reading back what was drawn since BeginFrame.
+  void EndFrame();
+  // Hand every frame still in flight to the encoder.
+  void Flush();
+
+  [[nodiscard]] int Width() const { return width_; }
+  [[nodiscard]] int Height() const { return height_; }
+
+ private:
+  static constexpr int kNumPbos = 3;
+
+  void CreateContext();
+  void CreateFramebuffer();
+  // Release the GL objects and the EGL context and display, whichever exist.
+  void Destroy();
+  // Map the oldest PBO in the ring and submit its frame, if it holds one.
+  void Collect(int slot);
+
+  int width_;
+  int height_;
+  FrameEncoderPool &encoder_;
+
+  EGLDisplay display_ = EGL_NO_DISPLAY;
+  EGLContext context_ = EGL_NO_CONTEXT;
+
+  GLuint framebuffer_ = 0;
+  GLuint color_renderbuffer_ = 0;
+  GLuint depth_renderbuffer_ = 0;
+  std::array<GLuint, kNumPbos> pbos_{};
+  std::array<GLsync, kNumPbos> fences_{};
+  std::array<int, kNumPbos> frame_indices_{};
+  int next_frame_ = 0;
+};
@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+"""
+Client for objective_server, see server/protocol.hpp for the protocol.
+
+  client = ObjectiveClient('/tmp/basketball_objective.sock')
+  objectives = client.evaluate(candidates)                  # N x num_dvs -> N
+  objectives, gradients = client.evaluate(candidates, gradient=True)
+
+Candidates are the flattened NX x NY design variables, row major. Batches larger than the server's
+max_batch are split over the shared memory slots and kept in flight together. With NumPy the
+results come back as arrays, otherwise as lists.
+
+  objective_client.py [--socket=PATH]   # evaluate the flat backboard as a smoke test
+"""
+
+import argparse
+import mmap
+import os
+import socket
+import struct
+import sys
+
+try:
+  import numpy as np
+except ImportError:
+  np = None
+
+MAGIC = 0x534f4242
+VERSION = 1
+HELLO_FORMAT = '=6IQ64s'
+MESSAGE_FORMAT = '=4I'
+REQUEST_GRADIENT = 1
+STATUS_MESSAGES = {1: 'bad request', 2: 'evaluation failed',
+                   3: 'design variables not finite or out of bounds'}
+STATUS_INVALID_DVS = 3
+
+
+def _recv_exactly(sock, size):
+  data = b''
+  while len(data) < size:
+    chunk = sock.recv(size - len(data))
+    if not chunk:
+      raise ConnectionError('objective server closed the connection')
+    data += chunk
+  return data
+
+
+class ObjectiveClient:
+  def __init__(self, socket_path='/tmp/basketball_objective.sock'):
+    self._sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    self._sock.connect(socket_path)
+    (magic, version, self.num_dvs, self.num_slots, self.max_batch, _, self.slot_bytes,
+     shm_name) = struct.unpack(HELLO_FORMAT, _recv_exactly(self._sock, struct.calcsize(HELLO_FORMAT)))
+    if magic != MAGIC or version != VERSION:
+      raise RuntimeError('not an objective server, or an incompatible version')
+    shm_name = shm_name.split(b'\0', 1)[0].decode()
+    fd = os.open('/dev/shm' + shm_name, os.O_RDWR)
+    try:
+      self._shm = mmap.mmap(fd, self.slot_bytes * self.num_slots)
+    finally:
+      os.close(fd)
+
+  def close(self):
+    self._sock.close()
+    self._shm.close()
+
+  def __enter__(self):
+    return self
+
+  def __exit__(self, *_):
+    self.close()
+
+  def _offsets(self, slot):
+    dvs = slot * self.slot_bytes
+    objective = dvs + 8 * self.max_batch * self.num_dvs
+    gradient = objective + 8 * self.max_batch
+    return dvs, objective, gradient
+
+  def _write(self, slot, candidates):
+    dvs, _, _ = self._offsets(slot)
+    if np is not None:
+      view = np.frombuffer(self._shm, dtype=np.float64, count=len(candidates) * self.num_dvs,
+                           offset=dvs)
+      view[:] = np.asarray(candidates, dtype=np.float64).ravel()
+    else:
+      flat = [float(v) for candidate in candidates for v in candidate]
+      struct.pack_into('=%dd' % len(flat), self._shm, dvs, *flat)
+
+  def _read(self, slot, count, gradient):
+    _, objective, gradient_offset = self._offsets(slot)
+    if np is not None:
+      objectives = np.frombuffer(self._shm, dtype=np.float64, count=count, offset=objective).copy()
+      gradients = None
+      if gradient:
+        gradients = np.frombuffer(self._shm, dtype=np.float64, count=count * self.num_dvs,
+                                  offset=gradient_offset).reshape(count, self.num_dvs).copy()
+      return objectives, gradients
+    objectives = list(struct.unpack_from('=%dd' % count, self._shm, objective))
+    gradients = None
+    if gradient:
+      flat = struct.unpack_from('=%dd' % (count * self.num_dvs), self._shm, gradient_offset)
+      gradients = [list(flat[k * self.num_dvs:(k + 1) * self.num_dvs]) for k in range(count)]
+    return objectives, gradients
+
+  def evaluate(self, candidates, gradient=False):
+    candidates = list(candidates)
+    for candidate in candidates:
+      if len(candidate) != self.num_dvs:
+        raise ValueError('expected %d design variables per candidate' % self.num_dvs)
+    batches = [candidates[k:k + self.max_batch] for k in range(0, len(candidates), self.max_batch)]
+    flags = REQUEST_GRADIENT if gradient else 0
+
+    objectives, gradients = [], []
+    in_flight = []  # (slot, count), oldest first
+    next_batch = 0
+    error = None  # once a batch fails, stop sending and only collect the outstanding replies
+    while (next_batch < len(batches) and error is None) or in_flight:
+      # Fill every free slot before waiting on the oldest reply.
+      while next_batch < len(batches) and error is None and len(in_flight) < self.num_slots:
+        slot = next_batch % self.num_slots
+        batch = batches[next_batch]
+        self._write(slot, batch)
+        self._sock.sendall(struct.pack(MESSAGE_FORMAT, slot, len(batch), flags, 0))
+        in_flight.append((slot, len(batch)))
+        next_batch += 1
+      slot, count = in_flight.pop(0)
+      reply_slot, reply_count, status, _ = struct.unpack(
+          MESSAGE_FORMAT, _recv_exactly(self._sock, struct.calcsize(MESSAGE_FORMAT)))
+      assert (reply_slot, reply_count) == (slot, count)
+      if status != 0 or error is not None:
+        if error is None:
+          message = 'objective server: ' + STATUS_MESSAGES.get(status, str(status))
+          error = ValueError(message) if status == STATUS_INVALID_DVS else RuntimeError(message)
+        continue
+      batch_objectives, batch_gradients = self._read(slot, count, gradient)
+      objectives.append(batch_objectives)
+      gradients.append(batch_gradients)
+    if error is not None:
+      raise error
+
+    if np is not None:
+      objectives = np.concatenate(objectives) if objectives else np.zeros(0)
+      if gradient:
+        gradients = (np.concatenate(gradients) if gradients else np.zeros((0, self.num_dvs)))
+    else:
+      objectives = [f for batch in objectives for f in batch]
+      if gradient:
+        gradients = [g for batch in gradients for g in batch]
+    return (objectives, gradients) if gradient else objectives
+
+
+def main():
+  parser = argparse.ArgumentParser(description=__doc__,
+                                   formatter_class=argparse.RawDescriptionHelpFormatter)
+  parser.add_argument('--socket', default='/tmp/basketball_objective.sock')
+  args = parser.parse_args()
+
+  with ObjectiveClient(args.socket) as client:
+    objectives, gradients = client.evaluate([[0.0] * client.num_dvs], gradient=True)
+    print('flat backboard: objective %.6g' % objectives[0])
+    print('gradient: ' + ' '.join('%.4g' % g for g in gradients[0]))
+  return 0
+
+
+if __name__ == '__main__':
+  sys.exit(main())
@@ -0,0 +1,381 @@
+// Long-lived objective evaluator for external optimizers, see server/protocol.hpp.
+//
+// usage: objective_server [--socket=PATH] [--shot-set=PATH] [--aero] [--threads=N]
+//                         [--slots=N] [--max-batch=N]
+
+#include <fcntl.h>       // for O_CREAT, O_EXCL, O_RDWR
+#include <sys/mman.h>    // for mmap, munmap, shm_open, shm_unlink, MAP_FAILED, MAP_SHARED, ...
+#include <sys/socket.h>  // for accept, bind, listen, socket, AF_UNIX, SOCK_STREAM
+#include <sys/un.h>      // for sockaddr_un
+#include <unistd.h>      // for close, ftruncate, getpid, read, unlink, write
+
+#include <algorithm>           // for max, min
+#include <atomic>              // for atomic
+#include <cinttypes>           // for PRIu64
+#include <condition_variable>  // for condition_variable
+#include <csignal>             // for signal, SIGPIPE, SIG_IGN
+#include <cstdio>              // for fprintf, snprintf, stderr
+#include <cstdlib>             // for EXIT_FAILURE, EXIT_SUCCESS, strtol
+#include <cstring>             // for memcpy, strncpy
+#include <exception>           // for exception_ptr, current_exception, rethrow_exception
+#include <functional>          // for function
+#include <iostream>            // for cerr, endl
+#include <mutex>               // for mutex, lock_guard, unique_lock
+#include <string>              // for string
+#include <thread>              // for thread
+#include <vector>              // for vector
+
+#include "bb3d/assert.hpp"        // for ASSERT
+#include "problem/aero.hpp"       // for AeroParameters, CheckAeroIntegratorAgainstBounce
+#include "problem/backboard.hpp"  // for Backboard
+#include "problem/config.hpp"     // for NX, NY, NU_OBJ, NV_OBJ, Vec2Dvs, DvsValid
+#include "problem/problem.hpp"    // for Problem
+#include "problem/shot_set.hpp"   // for ShotSet
+#include "server/protocol.hpp"    // for ObjectiveServerHello, ObjectiveServerRequest, ...
+
+// Central differences: the objective is smooth in the design variables away from the bounds.
+constexpr double kFiniteDifferenceStep = 1e-6;
+
+using Evaluator = std::function<double(const double *dvs)>;
+
+// A fixed set of threads that run one parallel loop at a time.
+class WorkerPool {
+ public:
+  explicit WorkerPool(const int num_threads) {
+    ASSERT(num_threads > 0);
+    // The calling thread works too.
+    for (int k = 1; k < num_threads; k++) {
+      workers_.emplace_back([this]() { Work(); });
+    }
+  }
+  ~WorkerPool() {
+    {
+      const std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    start_.notify_all();
+    for (std::thread &worker : workers_) {
+      worker.join();
+    }
+  }
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  // Calls task(k) for every k in [0, count) and returns once they have all finished. The first
+  // exception thrown by a task is rethrown here, after every worker is done with task.
+  void ParallelFor(const size_t count, const std::function<void(size_t)> &task) {
+    const std::lock_guard<std::mutex> one_loop_at_a_time(run_mutex_);
+    {
+      const std::lock_guard<std::mutex> lock(mutex_);
+      task_ = &task;
+      count_ = count;
+      next_ = 0;
+      busy_ = workers_.size();
+      error_ = nullptr;
+      generation_++;
+    }
+    start_.notify_all();
+    RunTasks(task, count);
+    std::exception_ptr error;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      done_.wait(lock, [this]() { return busy_ == 0; });
+      task_ = nullptr;
+      error = error_;
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+ private:
+  // Never throws: the first exception is kept for ParallelFor and the rest of the loop is skipped.
+  void RunTasks(const std::function<void(size_t)> &task, const size_t count) {
+    try {
+      for (size_t k = next_++; k < count; k = next_++) {
+        task(k);
+      }
+    } catch (...) {
+      const std::lock_guard<std::mutex> lock(mutex_);
+      if (!error_) {
+        error_ = std::current_exception();
+      }
+      next_ = count;
+    }
+  }
+
+  void Work() {
+    uint64_t seen_generation = 0;
+    for (;;) {
+      const std::function<void(size_t)> *task{};
+      size_t count{};
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        start_.wait(lock, [this, seen_generation]() {
+          return stopping_ || generation_ != seen_generation;
+        });
+        if (stopping_) {
+          return;
+        }
+        seen_generation = generation_;
+        task = task_;
+        count = count_;
+      }
+      RunTasks(*task, count);
+      {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        busy_--;
+      }
+      done_.notify_all();
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::mutex run_mutex_;
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  const std::function<void(size_t)> *task_ = nullptr;
+  size_t count_ = 0;
+  std::atomic<size_t> next_{0};
+  size_t busy_ = 0;
+  uint64_t generation_ = 0;
+  bool stopping_ = false;
+  std::exception_ptr error_;
+};
+
+struct ServerOptions {
+  std::string socket_path = "/tmp/basketball_objective.sock";
+  std::string shot_set_path;
+  bool aero = false;
+  int num_threads = static_cast<int>(std::max(1U, std::thread::hardware_concurrency()));
+  uint32_t num_slots = 4;
+  uint32_t max_batch = 256;
+};
+
+static bool ReadAll(const int fd, void *data, const size_t size) {
+  auto *bytes = static_cast<char *>(data);
+  size_t done = 0;
+  while (done < size) {
+    const ssize_t n = read(fd, &bytes[done], size - done);
+    if (n <= 0) {
+      return false;
+    }
+    done += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+static bool WriteAll(const int fd, const void *data, const size_t size) {
+  const auto *bytes = static_cast<const char *>(data);
+  size_t done = 0;
+  while (done < size) {
+    const ssize_t n = write(fd, &bytes[done], size - done);
+    if (n <= 0) {
+      return false;
+    }
+    done += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+static bool AllDvsValid(const double *slot, const uint32_t count) {
+  for (uint32_t candidate = 0; candidate < count; candidate++) {
+    if (!DvsValid(&slot[candidate * NX * NY])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Evaluate count candidates in a slot, and their gradients if asked, as one parallel loop.
+static void EvaluateSlot(double *slot, const uint32_t count, const uint32_t max_batch,
+                         const bool want_gradient, const Evaluator &evaluate, WorkerPool &pool) {
+  constexpr size_t n = NX * NY;
+  const double *dvs = slot;
+  double *objectives = &slot[max_batch * n];
+  double *gradients = &slot[max_batch * (n + 1)];
+
+  // Per candidate: f(x), then f(x + h e_i), f(x - h e_i) for every i.
+  const size_t per_candidate = want_gradient ? 2 * n + 1 : 1;
+  std::vector<double> values(count * per_candidate);
+  pool.ParallelFor(values.size(), [&](const size_t task) {
+    const size_t candidate = task / per_candidate;
+    const size_t j = task % per_candidate;
+    double x[n];
+    memcpy(x, &dvs[candidate * n], sizeof(x));
+    if (j > 0) {
+      const size_t i = (j - 1) / 2;
+      x[i] += (j % 2 == 1) ? kFiniteDifferenceStep : -kFiniteDifferenceStep;
+    }
+    values[task] = evaluate(x);
+  });
+
+  for (size_t candidate = 0; candidate < count; candidate++) {
+    const double *f = &values[candidate * per_candidate];
+    objectives[candidate] = f[0];
+    if (want_gradient) {
+      for (size_t i = 0; i < n; i++) {
+        gradients[candidate * n + i] = (f[1 + 2 * i] - f[2 + 2 * i]) / (2 * kFiniteDifferenceStep);
+      }
+    }
+  }
+}
+
+static void ServeConnection(const int fd, const int connection_id, const ServerOptions &options,
+                            const Evaluator &evaluate, WorkerPool &pool) {
+  constexpr size_t n = NX * NY;
+  ObjectiveServerHello hello{};
+  hello.magic = kObjectiveServerMagic;
+  hello.version = kObjectiveServerVersion;
+  hello.num_dvs = n;
+  hello.num_slots = options.num_slots;
+  hello.max_batch = options.max_batch;
+  // dvs, objective and gradient, rounded up to a page so every slot starts page aligned
+  const size_t slot_bytes = (options.max_batch * (2 * n + 1) * sizeof(double) + 4095) / 4096 * 4096;
+  hello.slot_bytes = slot_bytes;
+  snprintf(hello.shm_name, sizeof(hello.shm_name), "/basketball_objective_%d_%d", getpid(),
+           connection_id);
+
+  const size_t shm_bytes = slot_bytes * options.num_slots;
+  const int shm_fd = shm_open(hello.shm_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (shm_fd < 0 || ftruncate(shm_fd, static_cast<off_t>(shm_bytes)) != 0) {
+    fprintf(stderr, "connection %d: can't create shared memory %s\n", connection_id,
+            hello.shm_name);
+    if (shm_fd >= 0) {
+      close(shm_fd);
+      shm_unlink(hello.shm_name);
+    }
+    close(fd);
+    return;
+  }
+  void *shm = mmap(nullptr, shm_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+  close(shm_fd);
+  if (shm == MAP_FAILED) {
+    fprintf(stderr, "connection %d: can't map shared memory\n", connection_id);
+    shm_unlink(hello.shm_name);
+    close(fd);
+    return;
+  }
+
+  uint64_t num_evaluated = 0;
+  if (WriteAll(fd, &hello, sizeof(hello))) {
+    ObjectiveServerRequest request{};
+    while (ReadAll(fd, &request, sizeof(request))) {
+      ObjectiveServerReply reply{request.slot, request.count, kObjectiveServerOk, 0};
+      if (request.slot >= options.num_slots || request.count > options.max_batch) {
+        reply.status = kObjectiveServerBadRequest;
+      } else {
+        auto *slot = reinterpret_cast<double *>(static_cast<char *>(shm) +
+                                                request.slot * slot_bytes);
+        // One bad design would hit an ASSERT and take the server down for every connection.
+        if (!AllDvsValid(slot, request.count)) {
+          reply.status = kObjectiveServerInvalidDvs;
+        } else {
+          try {
+            EvaluateSlot(slot, request.count, options.max_batch,
+                         (request.flags & kObjectiveRequestGradient) != 0U, evaluate, pool);
+            num_evaluated += request.count;
+          } catch (const std::exception &e) {
+            fprintf(stderr, "connection %d: evaluation failed: %s\n", connection_id, e.what());
+            reply.status = kObjectiveServerEvaluationFailed;
+          }
+        }
+      }
+      if (!WriteAll(fd, &reply, sizeof(reply))) {
+        break;
+      }
+    }
+  }
+  fprintf(stderr, "connection %d closed after %" PRIu64 " candidates\n", connection_id,
+          num_evaluated);
+
+  munmap(shm, shm_bytes);
+  shm_unlink(hello.shm_name);
+  close(fd);
+}
+
+static int RunServer(const ServerOptions &options) {
+  const ShotSet shot_set =
+      options.shot_set_path.empty() ? ShotSet::Grid() : ShotSet::Load(options.shot_set_path);
+  Problem<NX, NY>::CheckShotsBelowBounces(
+      shot_set, Problem<NX, NY>::MaxBounceZ<NU_OBJ, NV_OBJ>(), options.shot_set_path);
+  const AeroParameters aero;
+  if (options.aero) {
+    CheckAeroIntegratorAgainstBounce();
+  }
+  Evaluator evaluate = [&shot_set, &aero, &options](const double *dvs) {
+    const Eigen::Matrix<glm::dvec3, NX, NY> control_points =
+        Backboard<NX, NY>::ToControlPoints(Vec2Dvs(dvs));
+    if (options.aero) {
+      return Problem<NX, NY>::AeroObjectiveFunction<NU_OBJ, NV_OBJ>(control_points, shot_set, aero);
+    }
+    return Problem<NX, NY>::ObjectiveFunction<NU_OBJ, NV_OBJ>(control_points, shot_set);
+  };
+  WorkerPool pool(options.num_threads);
+
+  const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (listen_fd < 0 || options.socket_path.size() >= sizeof(address.sun_path)) {
+    std::cerr << "can't create socket " << options.socket_path << std::endl;
+    return EXIT_FAILURE;
+  }
+  strncpy(address.sun_path, options.socket_path.c_str(), sizeof(address.sun_path) - 1);
+  unlink(options.socket_path.c_str());
+  if (bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+      listen(listen_fd, 16) != 0) {
+    std::cerr << "can't listen on " << options.socket_path << std::endl;
+    close(listen_fd);
+    return EXIT_FAILURE;
+  }
+  fprintf(stderr, "serving %dx%d objective over %zu shots on %s with %d threads\n", NU_OBJ,
+          NV_OBJ, shot_set.Size(), options.socket_path.c_str(), options.num_threads);
+
+  // Connections share the worker pool, so one client's batch gets every core.
+  for (int connection_id = 0;; connection_id++) {
+    const int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      continue;
+    }
+    std::thread([fd, connection_id, &options, &evaluate, &pool]() {
+      ServeConnection(fd, connection_id, options, evaluate, pool);
+    }).detach();
+  }
+}
+
+int main(int argc, char *argv[]) {
+  ServerOptions options;
+  for (int k = 1; k < argc; k++) {
+    const std::string arg = argv[k];
+    const size_t equals = arg.find('=');
+    const std::string flag = arg.substr(0, equals);
+    const std::string value = equals == std::string::npos ? "" : arg.substr(equals + 1);
+    if (flag == "--socket") {
+      options.socket_path = value;
+    } else if (flag == "--shot-set") {
+      options.shot_set_path = value;
+    } else if (arg == "--aero") {
+      options.aero = true;
+    } else if (flag == "--threads") {
+      options.num_threads = std::max(1, std::stoi(value));
+    } else if (flag == "--slots") {
+      options.num_slots = static_cast<uint32_t>(std::max(1, std::stoi(value)));
+    } else if (flag == "--max-batch") {
+      options.max_batch = static_cast<uint32_t>(std::max(1, std::stoi(value)));
+    } else {
+      std::cerr << "unrecognized argument: " << arg << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // A client hanging up mid-reply shouldn't take the server down with it.
+  signal(SIGPIPE, SIG_IGN);
+
+  try {
+    return RunServer(options);
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>  // for uint32_t, uint64_t
+
+// Wire protocol of the objective server. server/objective_client.py mirrors this file.
+//
+// A client connects to the server's Unix domain socket and immediately receives a Hello. The
+// Hello names a shared memory segment (open it with shm_open, or /dev/shm/<name> on Linux) made
+// for this connection, holding num_slots slots of slot_bytes each. Slot k starts at k * slot_bytes
+// and is laid out as native doubles:
+//
+//   dvs[max_batch][num_dvs]        written by the client
+//   objective[max_batch]           written by the server
+//   gradient[max_batch][num_dvs]   written by the server if requested
+//
+// To evaluate up to max_batch candidates the client fills a slot's dvs and sends a Request naming
+// the slot. The server evaluates all of them in parallel, writes the results into the same slot
+// and sends back a Reply. Only these 16 byte messages go through the socket. Requests are answered
+// in order, so a client can keep several slots in flight as a ring. The segment is unlinked when
+// the connection closes.
+
+constexpr uint32_t kObjectiveServerMagic = 0x534f4242;  // "BBOS"
+constexpr uint32_t kObjectiveServerVersion = 1;
+
+struct ObjectiveServerHello {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_dvs;
+  uint32_t num_slots;
+  uint32_t max_batch;
+  uint32_t reserved;
+  uint64_t slot_bytes;
+  char shm_name[64];
+};
+
+constexpr uint32_t kObjectiveRequestGradient = 1U << 0U;
+
+struct ObjectiveServerRequest {
+  uint32_t slot;
+  uint32_t count;
+  uint32_t flags;
+  uint32_t reserved;
+};
+
+enum ObjectiveServerStatus : uint32_t {
+  kObjectiveServerOk = 0,
+  kObjectiveServerBadRequest = 1,
+  kObjectiveServerEvaluationFailed = 2,
+  // a design variable was NaN, infinite or outside [kDvLowerBound, kDvUpperBound]
+  kObjectiveServerInvalidDvs = 3,
+};
+
+struct ObjectiveServerReply {
+  uint32_t slot;
+  uint32_t count;
+  uint32_t status;
+  uint32_t reserved;
+};
+
+static_assert(sizeof(ObjectiveServerHello) == 96, "hello layout is part of the protocol");
+static_assert(sizeof(ObjectiveServerRequest) == 16, "request layout is part of the protocol");
+static_assert(sizeof(ObjectiveServerReply) == 16, "reply layout is part of the protocol");